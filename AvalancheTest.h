@@ -10,8 +10,10 @@
 
 #include "Types.h"
 #include "Random.h"
+#include "Parallel.h"
 
 #include <vector>
+#include <algorithm>
 #include <stdio.h>
 #include <math.h>
 
@@ -23,8 +25,67 @@ double maxBias ( std::vector<int> & counts, int reps );
 
 //-----------------------------------------------------------------------------
 
-template < typename keytype, typename hashtype >
-void calcBias ( pfHash hash, std::vector<int> & counts, int reps, Rand & r, bool verbose )
+// Per-bit counters for the output bits that flipped. Bit i of each
+// difference goes into byte lane i of a uint64_t (bits 0-7 of byte 0 into
+// the first word, and so on), so a whole 64-bit word is added per output
+// byte and the lane adds vectorize. The byte lanes are flushed into the int
+// counters before they can overflow.
+
+struct BitCounter
+{
+  static const int flushreps = 255;
+
+  std::vector<uint64_t> lanes;
+  int pending;
+
+  BitCounter ( size_t bytes ) : lanes(bytes,0), pending(0)
+  {
+  }
+
+  // spread the 8 bits of b into the low bit of 8 byte lanes
+  static inline uint64_t expand ( uint8_t b )
+  {
+    uint64_t x = b;
+    x = (x | (x << 28)) & UINT64_C(0x0000000F0000000F);
+    x = (x | (x << 14)) & UINT64_C(0x0003000300030003);
+    x = (x | (x <<  7)) & UINT64_C(0x0101010101010101);
+    return x;
+  }
+
+  // add the bits of diff[0..bytes) to lanes[offset..offset+bytes)
+  inline void add ( size_t offset, const uint8_t * diff, int bytes )
+  {
+    uint64_t * lane = &lanes[offset];
+    for(int i = 0; i < bytes; i++)
+    {
+      lane[i] += expand(diff[i]);
+    }
+  }
+
+  // counts[8*i+k] += lane k of word i
+  void flush ( int * counts )
+  {
+    for(size_t i = 0; i < lanes.size(); i++)
+    {
+      uint64_t x = lanes[i];
+      for(int k = 0; k < 8; k++)
+      {
+        counts[8*i+k] += (int)((x >> (8*k)) & 0xFF);
+      }
+      lanes[i] = 0;
+    }
+    pending = 0;
+  }
+
+  // call after every rep
+  inline void step ( int * counts )
+  {
+    if(++pending == flushreps) flush(counts);
+  }
+};
+
+template < typename keytype, typename hashtype, typename hashfn >
+void calcBias ( hashfn hash, std::vector<int> & counts, int reps, Rand & r, bool verbose )
 {
   const int keybytes = sizeof(keytype);
   const int hashbytes = sizeof(hashtype);
@@ -32,42 +93,79 @@ void calcBias ( pfHash hash, std::vector<int> & counts, int reps, Rand & r, bool
   const int keybits = keybytes * 8;
   const int hashbits = hashbytes * 8;
 
-  keytype K;
-  hashtype A,B;
+  // The keys are drawn from r serially in blocks, then hashed on all
+  // threads. Each thread counts into its own arrays, which are summed at
+  // the end, so the counts do not depend on the thread count.
 
-  for(int irep = 0; irep < reps; irep++)
-  {
-    if(verbose) {
-      if(irep % (reps/10) == 0) printf(".");
-    }
+  const int chunk = 64;
+  const int blockreps = chunk * 1024;
 
-    r.rand_p(&K,keybytes);
+  const unsigned nthreads = g_NCPU;
 
-    hash(&K,keybytes,0,&A);
+  std::vector<BitCounter> lanes(nthreads, BitCounter(keybits*hashbytes));
+  std::vector< std::vector<int> > threadcounts(nthreads, std::vector<int>(keybits*hashbits,0));
 
-    int * cursor = &counts[0];
+  std::vector<keytype> keys(blockreps);
 
-    for(int iBit = 0; iBit < keybits; iBit++)
+  for(int block = 0; block < reps; block += blockreps)
+  {
+    const int blockend = std::min(block + blockreps, reps);
+
+    for(int irep = block; irep < blockend; irep++)
     {
-      flipbit(&K,keybytes,iBit);
-      hash(&K,keybytes,0,&B);
-      flipbit(&K,keybytes,iBit);
+      if(verbose) {
+        if(irep % (reps/10) == 0) printf(".");
+      }
 
-      for(int iOut = 0; iOut < hashbits; iOut++)
+      r.rand_p(&keys[irep-block],keybytes);
+    }
+
+    ParallelFor((blockend - block + chunk - 1) / chunk, nthreads, [&] ( size_t c, unsigned t )
+    {
+      BitCounter & lane = lanes[t];
+      int * tcounts = &threadcounts[t][0];
+
+      const int begin = block + (int)c * chunk;
+      const int end = std::min(begin + chunk, blockend);
+
+      for(int irep = begin; irep < end; irep++)
       {
-        int bitA = getbit(&A,hashbytes,iOut);
-        int bitB = getbit(&B,hashbytes,iOut);
+        keytype K = keys[irep-block];
+        hashtype A,B;
+
+        hash(&K,keybytes,0,&A);
+
+        for(int iBit = 0; iBit < keybits; iBit++)
+        {
+          flipbit(&K,keybytes,iBit);
+          hash(&K,keybytes,0,&B);
+          flipbit(&K,keybytes,iBit);
+
+          B = B ^ A;
+
+          lane.add(iBit*hashbytes, (const uint8_t*)&B, hashbytes);
+        }
 
-        (*cursor++) += (bitA ^ bitB);
+        lane.step(tcounts);
       }
+    });
+  }
+
+  for(unsigned t = 0; t < nthreads; t++)
+  {
+    lanes[t].flush(&threadcounts[t][0]);
+
+    for(size_t i = 0; i < counts.size(); i++)
+    {
+      counts[i] += threadcounts[t][i];
     }
   }
 }
 
 //-----------------------------------------------------------------------------
 
-template < typename keytype, typename hashtype >
-bool AvalancheTest ( pfHash hash, const int reps, bool verbose )
+template < typename keytype, typename hashtype, typename hashfn >
+bool AvalancheTest ( hashfn hash, const int reps, bool verbose )
 {
   Rand r(48273);
   
@@ -107,8 +205,8 @@ bool AvalancheTest ( pfHash hash, const int reps, bool verbose )
 // Tests the Bit Independence Criteron. Stricter than Avalanche, but slow and
 // not really all that useful.
 
-template< typename keytype, typename hashtype >
-void BicTest ( pfHash hash, const int keybit, const int reps, double & maxBias, int & maxA, int & maxB, bool verbose )
+template< typename keytype, typename hashtype, typename hashfn >
+void BicTest ( hashfn hash, const int keybit, const int reps, double & maxBias, int & maxA, int & maxB, bool verbose )
 {
   Rand r(11938);
   
@@ -192,8 +290,8 @@ void BicTest ( pfHash hash, const int keybit, const int reps, double & maxBias,
 
 //----------
 
-template< typename keytype, typename hashtype >
-bool BicTest ( pfHash hash, const int reps )
+template< typename keytype, typename hashtype, typename hashfn >
+bool BicTest ( hashfn hash, const int reps )
 {
   const int keybytes = sizeof(keytype);
   const int keybits = keybytes * 8;
@@ -233,15 +331,62 @@ bool BicTest ( pfHash hash, const int reps )
 //-----------------------------------------------------------------------------
 // BIC test variant - store all intermediate data in a table, draw diagram
 // afterwards (much faster)
+//
+// The differences are bit-sliced: for a batch of 64 reps, slice[out] holds
+// output bit out of every rep's difference, one rep per bit. The number of
+// reps with both out1 and out2 set is then popcount(slice[out1] &
+// slice[out2]), and the four bins of a pair follow from that and the single
+// bit counts. The key bits are independent and run on separate threads, each
+// with a copy of the Rand state at the start of its reps.
+
+template< typename hashtype >
+void BicSliceCount ( const hashtype * diffs, int n, uint32_t * ones, uint32_t * both )
+{
+  const int hashbits = sizeof(hashtype) * 8;
+
+  uint64_t slice[hashbits];
+  memset(slice, 0, sizeof(slice));
+
+  for(int r = 0; r < n; r++)
+  {
+    const uint8_t * d = (const uint8_t *)&diffs[r];
+
+    for(int i = 0; i < (int)sizeof(hashtype); i++)
+    {
+      if(d[i] == 0) continue;
+
+      for(int k = 0; k < 8; k++)
+      {
+        slice[8*i + k] |= uint64_t((d[i] >> k) & 1) << r;
+      }
+    }
+  }
+
+  for(int out1 = 0; out1 < hashbits; out1++)
+  {
+    const uint64_t a = slice[out1];
+
+    ones[out1] += (uint32_t)popcount8(a);
+
+    if(a == 0) continue;
 
-template< typename keytype, typename hashtype >
-bool BicTest3 ( pfHash hash, const int reps, bool verbose = false )
+    uint32_t * b = &both[out1*hashbits];
+
+    for(int out2 = out1+1; out2 < hashbits; out2++)
+    {
+      b[out2] += (uint32_t)popcount8(a & slice[out2]);
+    }
+  }
+}
+
+template< typename keytype, typename hashtype, typename hashfn >
+bool BicTest3 ( hashfn hash, const int reps, bool verbose = false )
 {
   const int keybytes = sizeof(keytype);
   const int keybits = keybytes * 8;
   const int hashbytes = sizeof(hashtype);
   const int hashbits = hashbytes * 8;
-  const int pagesize = hashbits*hashbits*4;
+  const int pagesize = hashbits + hashbits*hashbits;
 
   Rand r(11938);
 
@@ -250,37 +395,52 @@ bool BicTest3 ( pfHash hash, const int reps, bool verbose = false )
   int maxA = 0;
   int maxB = 0;
 
-  keytype key;
-  hashtype h1,h2;
+  // per key bit, the count of each output bit set, then of each pair set
+  std::vector<uint32_t> counts(keybits*pagesize,0);
 
-  std::vector<int> bins(keybits*pagesize,0);
+  // the Rand state at the start of each key bit
+  std::vector<Rand> rands(keybits);
 
   for(int keybit = 0; keybit < keybits; keybit++)
   {
     if(keybit % (keybits/10) == 0) printf(".");
 
-    int * page = &bins[keybit*pagesize];
+    rands[keybit] = r;
+
+    keytype key;
+    for(int irep = 0; irep < reps; irep++) r.rand_p(&key,keybytes);
+  }
+
+  ParallelFor(keybits, g_NCPU, [&] ( size_t keybit, unsigned )
+  {
+    Rand rk = rands[keybit];
+
+    uint32_t * ones = &counts[keybit*pagesize];
+    uint32_t * both = ones + hashbits;
+
+    keytype key;
+    hashtype h1,h2;
+    hashtype diffs[64];
+    int n = 0;
 
     for(int irep = 0; irep < reps; irep++)
     {
-      r.rand_p(&key,keybytes);
+      rk.rand_p(&key,keybytes);
       hash(&key,keybytes,0,&h1);
-      flipbit(key,keybit);
+      flipbit(key,(uint32_t)keybit);
       hash(&key,keybytes,0,&h2);
 
-      hashtype d = h1 ^ h2;
+      diffs[n++] = h1 ^ h2;
 
-      for(int out1 = 0; out1 < hashbits-1; out1++)
-      for(int out2 = out1+1; out2 < hashbits; out2++)
+      if(n == 64)
       {
-        int * b = &page[(out1*hashbits+out2)*4];
-
-        uint32_t x = getbit(d,out1) | (getbit(d,out2) << 1);
-
-        b[x]++;
+        BicSliceCount(diffs, n, ones, both);
+        n = 0;
       }
     }
-  }
+
+    BicSliceCount(diffs, n, ones, both);
+  });
 
   printf("\n");
 
@@ -292,8 +452,16 @@ bool BicTest3 ( pfHash hash, const int reps, bool verbose = false )
 
       for(int keybit = 0; keybit < keybits; keybit++)
       {
-        int * page = &bins[keybit*pagesize];
-        int * bins = &page[(out1*hashbits+out2)*4];
+        const uint32_t * ones = &counts[keybit*pagesize];
+        const uint32_t * both = ones + hashbits;
+
+        const int c11 = (int)both[out1*hashbits+out2];
+
+        int bins[4];
+        bins[3] = c11;
+        bins[1] = (int)ones[out1] - c11;
+        bins[2] = (int)ones[out2] - c11;
+        bins[0] = reps - bins[1] - bins[2] - bins[3];
 
         double bias = 0;
 
@@ -345,8 +513,8 @@ bool BicTest3 ( pfHash hash, const int reps, bool verbose = false )
 // BIC test variant - iterate over output bits, then key bits. No temp storage,
 // but slooooow
 
-template< typename keytype, typename hashtype >
-void BicTest2 ( pfHash hash, const int reps, bool verbose = true )
+template< typename keytype, typename hashtype, typename hashfn >
+void BicTest2 ( hashfn hash, const int reps, bool verbose = true )
 {
   const int keybytes = sizeof(keytype);
   const int keybits = keybytes * 8;
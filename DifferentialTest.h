@@ -8,6 +8,7 @@
 #include "Stats.h"      // for chooseUpToK
 #include "KeysetTest.h" // for SparseKeygenRecurse
 #include "Random.h"
+#include "Parallel.h"
 
 #include <vector>
 #include <algorithm>
@@ -21,7 +22,7 @@
 template < class keytype >
 bool ProcessDifferentials ( std::vector<keytype> & diffs, int reps, bool dumpCollisions )
 {
-  std::sort(diffs.begin(), diffs.end());
+  RadixSort(diffs);
 
   int count = 1;
   int ignore = 0;
@@ -100,8 +101,8 @@ bool ProcessDifferentials ( std::vector<keytype> & diffs, int reps, bool dumpCol
 // 2^32 tests, we'll probably see some spurious random collisions, so don't report
 // them.
 
-template < typename keytype, typename hashtype >
-void DiffTestRecurse ( pfHash hash, keytype & k1, keytype & k2, hashtype & h1, hashtype & h2, int start, int bitsleft, std::vector<keytype> & diffs )
+template < typename keytype, typename hashtype, typename hashfn >
+void DiffTestRecurse ( hashfn hash, keytype & k1, keytype & k2, hashtype & h1, hashtype & h2, int start, int bitsleft, std::vector<keytype> & diffs )
 {
   const int bits = sizeof(keytype)*8;
 
@@ -129,8 +130,8 @@ void DiffTestRecurse ( pfHash hash, keytype & k1, keytype & k2, hashtype & h1, h
 
 //----------
 
-template < typename keytype, typename hashtype >
-bool DiffTest ( pfHash hash, int diffbits, int reps, bool dumpCollisions )
+template < typename keytype, typename hashtype, typename hashfn >
+bool DiffTest ( hashfn hash, int diffbits, int reps, bool dumpCollisions )
 {
   const int keybits = sizeof(keytype) * 8;
   const int hashbits = sizeof(hashtype) * 8;
@@ -141,29 +142,44 @@ bool DiffTest ( pfHash hash, int diffbits, int reps, bool dumpCollisions )
 
   Rand r(100);
 
-  std::vector<keytype> diffs;
-
-  keytype k1,k2;
-  hashtype h1,h2;
-
   printf("Testing %0.f up-to-%d-bit differentials in %d-bit keys -> %d bit hashes.\n",
          diffcount,diffbits,keybits,hashbits);
   printf("%d reps, %0.f total tests, expecting %2.2f random collisions",
          reps,testcount,expected);
 
+  // The keys are drawn up front, so every rep can run on any thread. Each
+  // thread collects its own diffs, merged (and sorted) afterwards.
+
+  std::vector<keytype> keys(reps);
+
   for(int i = 0; i < reps; i++)
   {
     if(i % (reps/10) == 0) printf(".");
 
-    r.rand_p(&k1,sizeof(keytype));
-    k2 = k1;
+    r.rand_p(&keys[i],sizeof(keytype));
+  }
+
+  std::vector< std::vector<keytype> > threaddiffs(g_NCPU);
+
+  ParallelFor(reps, g_NCPU, [&] ( size_t i, unsigned t )
+  {
+    keytype k1 = keys[i];
+    keytype k2 = k1;
+    hashtype h1,h2;
 
     hash(&k1,sizeof(k1),0,(uint32_t*)&h1);
 
-    DiffTestRecurse<keytype,hashtype>(hash,k1,k2,h1,h2,0,diffbits,diffs);
-  }
+    DiffTestRecurse<keytype,hashtype>(hash,k1,k2,h1,h2,0,diffbits,threaddiffs[t]);
+  });
   printf("\n");
 
+  std::vector<keytype> diffs;
+
+  for(unsigned t = 0; t < threaddiffs.size(); t++)
+  {
+    diffs.insert(diffs.end(), threaddiffs[t].begin(), threaddiffs[t].end());
+  }
+
   bool result = true;
 
   result &= ProcessDifferentials(diffs,reps,dumpCollisions);
@@ -187,8 +203,8 @@ bool DiffTest ( pfHash hash, int diffbits, int reps, bool dumpCollisions )
 
 // #TODO - put diagram drawing back on
 
-template < typename keytype, typename hashtype >
-void DiffDistTest ( pfHash hash, const int diffbits, int trials, double & worst, double & avg )
+template < typename keytype, typename hashtype, typename hashfn >
+void DiffDistTest ( hashfn hash, const int diffbits, int trials, double & worst, double & avg )
 {
   std::vector<keytype>  keys(trials);
   std::vector<hashtype> A(trials),B(trials);
@@ -244,17 +260,19 @@ void DiffDistTest ( pfHash hash, const int diffbits, int trials, double & worst,
 // generate random key pairs and run full distribution/collision tests on the
 // hash differentials
 
-template < typename keytype, typename hashtype >
-bool DiffDistTest2 ( pfHash hash, bool drawDiagram )
+template < typename keytype, typename hashtype, typename hashfn >
+bool DiffDistTest2 ( hashfn hash, bool drawDiagram )
 {
   Rand r(857374);
 
   int keybits = sizeof(keytype) * 8;
   const int keycount = 256*256*32;
-  keytype k;
-  
+
+  // Each bit's keys are drawn up front, so the pairs can be hashed on any
+  // thread into the one reused hashes vector.
+
+  std::vector<keytype>  keys(keycount);
   std::vector<hashtype> hashes(keycount);
-  hashtype h1,h2;
 
   bool result = true;
 
@@ -264,14 +282,20 @@ bool DiffDistTest2 ( pfHash hash, bool drawDiagram )
 
     for(int i = 0; i < keycount; i++)
     {
-      r.rand_p(&k,sizeof(keytype));
-      
+      r.rand_p(&keys[i],sizeof(keytype));
+    }
+
+    ParallelFor(keycount, g_NCPU, [&] ( size_t i, unsigned )
+    {
+      keytype k = keys[i];
+      hashtype h1,h2;
+
       hash(&k,sizeof(keytype),0,&h1);
       flipbit(&k,sizeof(keytype),keybit);
       hash(&k,sizeof(keytype),0,&h2);
 
       hashes[i] = h1 ^ h2;
-    }
+    });
 
     result &= TestHashList<hashtype>(hashes,true,true,drawDiagram);
     printf("\n");
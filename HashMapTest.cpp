@@ -3,11 +3,20 @@
 #include "SpeedTest.h"
 #include "Random.h"
 
+#include <ctype.h>
 #include <string>
 #include <unordered_map>
 #include <functional>
 #include <iostream>
 #include <fstream>
+#include <iterator>
+
+#if !defined(_MSC_VER)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
@@ -15,37 +24,252 @@ using namespace std;
 // This should be a realistic I-Cache test, when our hash is used inlined
 // in a hash table. There the size matters more than the bulk speed.
 
-std::vector<std::string> HashMapInit(bool verbose) {
-  std::vector<std::string> words;
-  std::string line;
-  std::string filename = "/usr/share/dict/words";
-  int lines = 0, sum = 0;
-  std::ifstream wordfile(filename.c_str());
-  if (!wordfile.is_open()) {
-    std::cout << "Unable to open words dict file " << filename << "\n";
-    return words;
-  }
-  while (getline(wordfile, line)) {
-    int len = line.length();
-    lines++;
-    sum += len;
-    words.push_back(line);
-  }
-  wordfile.close();
+HashMapWords::~HashMapWords ( )
+{
+#if !defined(_MSC_VER)
+  if (mapping)
+    munmap(mapping, mappinglen);
+#endif
+}
+
+// The contents of a keys file, mapped read-only where mmap is available and
+// read into the arena otherwise. NULL if the file cannot be read.
+
+static const char * MapKeysFile ( HashMapWords & words, const char * filename,
+                                  size_t & len ) {
+  static const char empty = 0;
+#if !defined(_MSC_VER)
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+  if (fd < 0)
+    return NULL;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    void * p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      close(fd);
+      madvise(p, st.st_size, MADV_WILLNEED);
+      words.mapping = p;
+      words.mappinglen = len = st.st_size;
+      return (const char *)p;
+    }
+  }
+  close(fd);
+#endif
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.is_open())
+    return NULL;
+  words.arena.assign(std::istreambuf_iterator<char>(file),
+                     std::istreambuf_iterator<char>());
+  len = words.arena.size();
+  return len ? words.arena.data() : &empty;
+}
+
+// Newline separated keys, a trailing \r is dropped
+static void SplitLines ( HashMapWords & words, const char * p, size_t len ) {
+  const char * end = p + len;
+  while (p < end) {
+    const char * nl = (const char *)memchr(p, '\n', end - p);
+    const char * e = nl ? nl : end;
+    size_t n = e - p;
+    if (n && p[n - 1] == '\r')
+      n--;
+    words.keys.push_back(HashMapKey(p, n));
+    p = nl ? nl + 1 : end;
+  }
+}
+
+// Keys with a 32-bit little endian length prefix, false if truncated
+static bool SplitLengthPrefixed ( HashMapWords & words, const char * p, size_t len ) {
+  const uint8_t * q = (const uint8_t *)p;
+  const uint8_t * end = q + len;
+  while (q < end) {
+    if (end - q < 4)
+      return false;
+    size_t n = (size_t)q[0] | (size_t)q[1] << 8 | (size_t)q[2] << 16 | (size_t)q[3] << 24;
+    q += 4;
+    if ((size_t)(end - q) < n)
+      return false;
+    words.keys.push_back(HashMapKey((const char *)q, n));
+    q += n;
+  }
+  return true;
+}
+
+static const char * corpora[] = { "uuid", "url", "int64", "log" };
+
+// count keys of the given synthetic corpus, generated into the arena
+static void SyntheticKeys ( HashMapWords & words, const std::string & kind,
+                            size_t count ) {
+  static const char * hosts[] = { "www.example.com", "api.example.com",
+    "cdn.static.example.net", "shop.example.org", "accounts.example.com",
+    "img1.example-cdn.com" };
+  static const char * dirs[] = { "api", "v1", "v2", "users", "items",
+    "products", "search", "static", "images", "orders", "cart", "docs" };
+  static const char * services[] = { "api-gateway", "auth", "billing",
+    "search", "ingest", "scheduler", "storage", "web" };
+  static const char * levels[] = { "DEBUG", "INFO", "INFO", "INFO", "WARN",
+    "ERROR" };
+  static const char * events[] = { "request.start", "request.end",
+    "db.query", "cache.miss", "cache.hit", "retry", "timeout", "conn.open",
+    "conn.close" };
+#define PICK(a) a[r.rand_u32() % (sizeof(a) / sizeof(a[0]))]
+  Rand r(731279);
+  std::vector<size_t> offsets;
+  char buf[256];
+  for (size_t i = 0; i < count; i++) {
+    int n = 0;
+    if (kind == "uuid") { // version 4
+      uint64_t a = r.rand_u64(), b = r.rand_u64();
+      n = snprintf(buf, sizeof(buf), "%08x-%04x-4%03x-%04x-%012llx",
+                   (uint32_t)(a >> 32), (uint32_t)(a >> 16) & 0xffff,
+                   (uint32_t)a & 0xfff, 0x8000 | ((uint32_t)(b >> 48) & 0x3fff),
+                   (unsigned long long)(b & 0xffffffffffffULL));
+    } else if (kind == "int64") {
+      uint64_t v = r.rand_u64();
+      memcpy(buf, &v, sizeof(v));
+      n = sizeof(v);
+    } else if (kind == "url") {
+      n = snprintf(buf, sizeof(buf), "https://%s", PICK(hosts));
+      for (int j = r.rand_u32() % 4; j >= 0; j--)
+        n += snprintf(buf + n, sizeof(buf) - n, "/%s", PICK(dirs));
+      if (r.rand_u32() & 1)
+        n += snprintf(buf + n, sizeof(buf) - n, "/%u", r.rand_u32() % 1000000);
+      if (r.rand_u32() % 4 == 0)
+        n += snprintf(buf + n, sizeof(buf) - n, "?id=%08x&page=%u",
+                      r.rand_u32(), r.rand_u32() % 100);
+    } else { // log
+      const char * service = PICK(services);
+      unsigned host = r.rand_u32() % 32;
+      const char * level = PICK(levels);
+      n = snprintf(buf, sizeof(buf), "%s-%02u:%s:%s:%010u", service, host,
+                   level, PICK(events), r.rand_u32());
+    }
+    offsets.push_back(words.arena.size());
+    words.arena.insert(words.arena.end(), buf, buf + n);
+  }
+#undef PICK
+  // the arena is complete, it does not move any more
+  offsets.push_back(words.arena.size());
+  for (size_t i = 0; i + 1 < offsets.size(); i++)
+    words.keys.push_back(HashMapKey(words.arena.data() + offsets[i],
+                                    offsets[i + 1] - offsets[i]));
+}
+
+bool HashMapInit ( HashMapWords & words, const char * spec, bool verbose ) {
+  std::string source = spec ? spec : "/usr/share/dict/words";
+  std::string kind = source.substr(0, source.find(':'));
+  bool synthetic = false;
+  for (size_t i = 0; i < sizeof(corpora) / sizeof(corpora[0]); i++)
+    synthetic |= kind == corpora[i];
+
+  if (synthetic) {
+    size_t count = 100000;
+    if (kind.size() < source.size()) {
+      const char * n = source.c_str() + kind.size() + 1;
+      char * end;
+      count = isdigit((unsigned char)*n) ? strtoul(n, &end, 10) : 0;
+      if (count == 0 || *end) {
+        printf("Invalid key count in %s\n", source.c_str());
+        return false;
+      }
+    }
+    SyntheticKeys(words, kind, count);
+  } else {
+    bool binary = kind == "binary" && kind.size() < source.size();
+    std::string filename = binary ? source.substr(kind.size() + 1) : source;
+    size_t len = 0;
+    const char * p = MapKeysFile(words, filename.c_str(), len);
+    if (!p && !spec) {
+      printf("Unable to open words dict file %s, using synthetic log keys\n",
+             filename.c_str());
+      source = "log";
+      SyntheticKeys(words, source, 100000);
+    } else if (!p) {
+      printf("Unable to open keys file %s\n", filename.c_str());
+      return false;
+    } else if (binary) {
+      if (!SplitLengthPrefixed(words, p, len)) {
+        printf("Truncated keys file %s\n", filename.c_str());
+        return false;
+      }
+    } else {
+      SplitLines(words, p, len);
+    }
+  }
+
+  if (words.keys.empty()) {
+    printf("No keys in %s\n", source.c_str());
+    return false;
+  }
+
+  words.bytes = 0;
+  for (size_t i = 0; i < words.keys.size(); i++)
+    words.bytes += words.keys[i].len;
   if (verbose) {
-    printf ("Read %d words from '%s'\n", lines, filename.c_str());
-    printf ("Avg len: %0.3f\n", (sum+0.0)/lines);
+    printf ("Read %zu keys from '%s'\n", words.size(), source.c_str());
+    printf ("Avg len: %0.3f\n", words.size() ? (double)words.bytes / words.size() : 0.0);
   }
-  return words;
+  return true;
+}
+
+bool ParseHashMapProfile ( const char * spec, HashMapProfile & profile ) {
+  char grow[8] = "";
+  profile.name = "custom";
+  int n = sscanf(spec, "%u/%u/%u,%u,%lf,%7s", &profile.read, &profile.write,
+                 &profile.erase, &profile.hit, &profile.load, grow);
+  if (n < 5 || (n == 6 && strcmp(grow, "grow") != 0))
+    return false;
+  profile.reserve = n == 5;
+  return profile.read + profile.write + profile.erase == 100 &&
+         profile.hit <= 100 && profile.load > 0.0 && profile.load <= 0.875;
+}
+
+double HashMapProbeStats::Mean ( ) const {
+  size_t sum = 0;
+  for (size_t i = 0; i < groups.size(); i++)
+    sum += i * groups[i];
+  return lookups ? (double)sum / lookups : 0.0;
+}
+
+size_t HashMapProbeStats::Percentile ( double p ) const {
+  size_t n = 0;
+  for (size_t i = 0; i < groups.size(); i++) {
+    n += groups[i];
+    if (n >= p * lookups)
+      return i;
+  }
+  return Max();
+}
+
+void HashMapProbeReport ( const HashMapProbeStats & stats, bool hits ) {
+  if (stats.lookups == 0)
+    return;
+  const double lookups = (double)stats.lookups;
+  size_t fill = 0;
+  for (size_t i = 0; i < stats.homefill.size(); i++)
+    fill += i * stats.homefill[i];
+  // each other key find() passes matches with 1/128
+  const double uniform = (double)stats.full / 128.0 / lookups;
+
+  printf("%-4s - groups probed p50 %zu, p90 %zu, p99 %zu, max %zu, mean %0.3f\n",
+         hits ? "hit" : "miss", stats.Percentile(0.5), stats.Percentile(0.9),
+         stats.Percentile(0.99), stats.Max(), stats.Mean());
+  printf("       home group %0.2f/%zu full, %0.2f%% of the lookups "
+         "in a full one\n", fill / lookups, stats.homefill.size() - 1,
+         100.0 * stats.homefill.back() / lookups);
+  printf("       H2 false matches %0.4f/lookup, %0.4f with uniform tags\n",
+         stats.falsematches / lookups, uniform);
 }
 
 bool HashMapTest ( pfHash pfhash, 
-                   const int hashbits, std::vector<std::string> words,
+                   const int hashbits, const HashMapWords & words,
                    const int trials, bool verbose )
 {
   double mean = 0.0;
+  PerfCounts perf;
+  PerfClear(perf);
   try {
-    mean = HashMapSpeedTest( pfhash, hashbits, words, trials, verbose);
+    mean = HashMapSpeedTest( pfhash, hashbits, words, trials, verbose, &perf);
   }
   catch (...) {
     printf(" aborted !!!!\n");
@@ -55,5 +279,6 @@ bool HashMapTest ( pfHash pfhash,
     printf(" ....... PASS\n");
   else
     printf(" ....... FAIL\n");
+  PerfReport(perf, "op");
   return true;
 }
@@ -2,8 +2,673 @@
 
 #include "Platform.h"
 #include "Types.h"
+#include "SpeedTest.h"
+#include "Random.h"
+// Constructing a parallel map with a bucket count move-assigns sized
+// submaps over the default ones, whose control bytes are phmap's static
+// empty_group. GCC 12 cannot see that those are never freed and warns.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wfree-nonheap-object"
+#include "parallel_hashmap/phmap.h"
+#pragma GCC diagnostic pop
+#else
+#include "parallel_hashmap/phmap.h"
+#endif
 
-std::vector<std::string> HashMapInit(bool verbose);
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+//-----------------------------------------------------------------------------
+// The keys of the hash map tests view the words in one contiguous arena, so
+// that inserts and lookups measure hashing and probing, not string copies.
+// A string_view, which C++11 does not have yet.
+
+struct HashMapKey
+{
+  HashMapKey ( ) : ptr(NULL), len(0)
+  {
+  }
+
+  HashMapKey ( const char * p, size_t n ) : ptr(p), len(n)
+  {
+  }
+
+  HashMapKey ( const std::string & s ) : ptr(s.data()), len(s.size())
+  {
+  }
+
+  bool operator == ( const HashMapKey & k ) const
+  {
+    return len == k.len && memcmp(ptr, k.ptr, len) == 0;
+  }
+
+  const char * ptr;
+  size_t len;
+};
+
+// Compares std::string and HashMapKey keys, for heterogeneous lookup of
+// std::string keyed maps by HashMapKey
+
+struct HashMapKeyEq
+{
+  typedef void is_transparent;
+
+  bool operator () ( const HashMapKey & a, const HashMapKey & b ) const
+  {
+    return a == b;
+  }
+};
+
+// The keys come from the arena, or from a keys file mapped into memory,
+// without copying
+
+struct HashMapWords
+{
+  HashMapWords ( ) : bytes(0), mapping(NULL), mappinglen(0)
+  {
+  }
+
+  ~HashMapWords ( );
+
+  std::vector<char> arena;
+  std::vector<HashMapKey> keys; // into arena or mapping, in file order
+  uint64_t bytes;
+  void * mapping;
+  size_t mappinglen;
+
+  size_t size ( void ) const { return keys.size(); }
+
+private:
+
+  HashMapWords ( const HashMapWords & );
+  HashMapWords & operator = ( const HashMapWords & );
+};
+
+// Loads the keys given with --keys=spec, /usr/share/dict/words without:
+//   FILE                newline separated keys
+//   binary:FILE         keys with a 32-bit little endian length prefix each
+//   uuid[:N]            N (100000) synthetic keys of the kind: UUIDs,
+//   url[:N]             URLs, 8-byte integers or log keys
+//   int64[:N]
+//   log[:N]
+// Falls back to the log keys if the dictionary is missing. False if the
+// keys file cannot be read.
+
+bool HashMapInit ( HashMapWords & words, const char * spec, bool verbose );
 bool HashMapTest ( pfHash pfhash, 
-                   const int hashbits, std::vector<std::string> words,
+                   const int hashbits, const HashMapWords & words,
                    const int trials, bool verbose );
+double HashMapSpeedTest ( pfHash pfhash, int hashbits, const HashMapWords & words,
+                          const int trials, bool verbose, PerfCounts * perf = NULL );
+
+//-----------------------------------------------------------------------------
+// The hash map test again, with the hash as a template functor in the map
+// hasher and its output on the stack. The std::function hashers of
+// HashMapSpeedTest add an indirect call and a write to a shared static
+// buffer to every lookup, which hides the differences between the hashes.
+// With a statichashfunc the hash is inlined into the map's lookup.
+
+// Only the bytes the hash writes are read back. A wider load which overlaps
+// the hash's store cannot be forwarded from it and costs about as much as
+// the rest of a lookup.
+
+template < typename hashtype, typename hashfn >
+struct HashMapHasher
+{
+  typedef void is_transparent; // std::string and HashMapKey
+
+  HashMapHasher ( hashfn hash, uint32_t seed ) : m_hash(hash), m_seed(seed)
+  {
+  }
+
+  // for the submaps of phmap's parallel maps, which are default constructed
+  // and then assigned a copy of the real one
+  HashMapHasher ( ) : m_hash(NULL), m_seed(0)
+  {
+  }
+
+  size_t operator () ( const HashMapKey & key ) const
+  {
+    uint64_t out[32]; // 256 bytes needed for hasshe2, but only size_t used
+    size_t h = 0;
+    m_hash(key.ptr, (int)key.len, m_seed, (uint32_t*)out);
+    memcpy(&h, out, sizeof(hashtype) < sizeof(size_t) ? sizeof(hashtype) : sizeof(size_t));
+    return h;
+  }
+
+  mutable hashfn m_hash;
+  uint32_t m_seed;
+};
+
+// Inserts the words with 1% deletions, then looks them all up trials
+// times. Returns the mean lookup cycles/op, 0 if the inserts are too slow.
+// Keys are built from the HashMapKeys for inserts only, lookups go by
+// HashMapKey. name must differ from HashMapSpeedTest's "std" and "fast",
+// whose lines speed.pl and speed.sh pick up.
+
+template < typename maptype >
+double HashMapLookupTest ( maptype & hashmap, const char * name,
+                           const HashMapWords & words, const int trials,
+                           PerfCounts & perf )
+{
+  typedef typename maptype::key_type key_type;
+  std::vector<HashMapKey>::const_iterator it;
+  std::vector<double> times;
+  double t1;
+
+  printf("Init %s HashMapTest:%*s", name, (int)(16 - strlen(name)), "");
+  fflush(NULL);
+  { // hash inserts and 1% deletes
+    volatile int64_t begin, end;
+    int i = 0;
+    begin = timer_start();
+    for (it = words.keys.begin(); it != words.keys.end(); it++, i++) {
+      hashmap[key_type(it->ptr, it->len)] = 1;
+      if (i % 100 == 0)
+        hashmap.erase(key_type(it->ptr, it->len));
+    }
+    end = timer_end();
+    t1 = (double)(end - begin) / (double)words.size();
+  }
+  printf("%0.3f cycles/op (%zu inserts, 1%% deletions)\n",
+         t1, words.size());
+  printf("Running %s HashMapTest:%*s", name, (int)(13 - strlen(name)), "");
+  if (t1 > 10000.) {
+    printf("SKIP");
+    return 0.;
+  }
+  fflush(NULL);
+
+  times.reserve(trials);
+  for(int itrial = 0; itrial < trials; itrial++)
+    { // hash query
+      volatile int64_t begin, end;
+      int i = 0, found = 0;
+      double t;
+      PerfRegion region(perf, words.size(), words.bytes);
+      begin = timer_start();
+      for ( it = words.keys.begin(); it != words.keys.end(); it++, i++ )
+        {
+          if (hashmap.find(*it) != hashmap.end())
+            found++;
+        }
+      end = timer_end();
+      t = (double)(end - begin) / (double)words.size();
+      if(found > 0 && t > 0) times.push_back(t);
+    }
+  hashmap.clear();
+
+  std::sort(times.begin(),times.end());
+  FilterOutliers(times);
+  double mean = CalcMean(times);
+  printf("%0.3f cycles/op", mean);
+  printf(" (%0.1f stdv)", CalcStdv(times));
+  fflush(NULL);
+
+  return mean;
+}
+
+// The phmap table owns std::string keys, like the tables of an
+// application, and is searched by HashMapKey through heterogeneous lookup.
+// std::unordered_map has no heterogeneous lookup in C++11 and is keyed by
+// HashMapKey.
+
+template < typename hashtype, typename hashfn >
+bool HashMapInlinedTest ( hashfn hash, const HashMapWords & words,
+                          const int trials )
+{
+  typedef HashMapHasher<hashtype, hashfn> hasher_t;
+  Rand r(82762); // the seed of HashMapSpeedTest
+  const uint32_t seed = r.rand_u32();
+  const hasher_t hasher(hash, seed);
+  PerfCounts stdperf, fastperf;
+  double mean = 0.0;
+
+  PerfClear(stdperf);
+  PerfClear(fastperf);
+
+  try {
+    std::unordered_map<HashMapKey, int, hasher_t, HashMapKeyEq> hashmap(words.size(), hasher);
+    phmap::flat_hash_map<std::string, int, hasher_t, HashMapKeyEq> phashmap(words.size(), hasher);
+
+    printf("\nstd::unordered_map, inlined hasher\n");
+    if (HashMapLookupTest(hashmap, "std inlined", words, trials, stdperf) > 0.) {
+      printf("\n");
+      PerfReport(stdperf, "op");
+
+      printf("\ngreg7mdp/parallel-hashmap, inlined hasher\n");
+      mean = HashMapLookupTest(phashmap, "fast inlined", words, trials, fastperf);
+    }
+  }
+  catch (...) {
+    printf(" aborted !!!!\n");
+  }
+  // if faster than ~sha1
+  if (mean > 5. && mean < 1500.)
+    printf(" ....... PASS\n");
+  else
+    printf(" ....... FAIL\n");
+  PerfReport(fastperf, "op");
+  if (mean > 0.)
+    HashMapProbeTest(hasher, words);
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+// Probe statistics of the flat phmap tables. raw_hash_set grants its tests
+// access to its internals through this struct, which phmap itself leaves
+// undefined.
+
+namespace phmap {
+namespace container_internal {
+
+struct RawHashSetTestOnlyAccess
+{
+  enum { kWidth = Group::kWidth };
+
+  struct Probe
+  {
+    size_t groups;       // groups probed, 1 if the key is in its home group
+    size_t falsematches; // slots with the 7 bit H2 tag of key but another key
+    size_t full;         // full slots find() passes before reaching key
+    size_t homefill;     // full slots in the first group
+  };
+
+  // Replays find() for key, up to the slot with the key or the first group
+  // with an empty slot
+
+  template < class Policy, class Hash, class Eq, class Alloc, class K >
+  static Probe Find ( const raw_hash_set<Policy, Hash, Eq, Alloc> & set,
+                      const K & key )
+  {
+    typedef raw_hash_set<Policy, Hash, Eq, Alloc> settype;
+    typedef typename settype::PolicyTraits PolicyTraits;
+    const size_t hash = typename settype::HashElement{set.hash_ref()}(key);
+    auto seq = set.probe(hash);
+    Probe probe = { 0, 0, 0, 0 };
+
+    for (;;) {
+      Group g{set.ctrl_ + seq.offset()};
+      size_t full = kWidth;
+      for (int i : g.MatchEmptyOrDeleted()) {
+        (void)i;
+        full--;
+      }
+      if (probe.groups++ == 0)
+        probe.homefill = full;
+      for (int i : g.Match(H2(hash))) {
+        if (PolicyTraits::apply(typename settype::template EqualElement<K>{key, set.eq_ref()},
+                                PolicyTraits::element(set.slots_ + seq.offset(i)))) {
+          // the matches come in slot order, the full slots before key
+          probe.full += i;
+          for (int j : g.MatchEmptyOrDeleted())
+            probe.full -= j < i;
+          return probe;
+        }
+        probe.falsematches++;
+      }
+      probe.full += full;
+      if (g.MatchEmpty())
+        return probe;
+      seq.next();
+    }
+  }
+
+  // slots holding a tombstone of an erased key
+  template < class Policy, class Hash, class Eq, class Alloc >
+  static size_t Deleted ( const raw_hash_set<Policy, Hash, Eq, Alloc> & set )
+  {
+    size_t n = 0;
+    for (size_t i = 0; i < set.capacity_; i++)
+      n += IsDeleted(set.ctrl_[i]);
+    return n;
+  }
+};
+
+} // namespace container_internal
+} // namespace phmap
+
+//-----------------------------------------------------------------------------
+// Workload profiles for phmap::flat_hash_map. The keys are split into a
+// present half, of which the first keys are inserted to reach the load
+// factor, and a half which is never inserted, for the misses. Reads look up
+// a present key with the hit probability, else a missing one, writes insert
+// and erases erase a random key of the present part. Growth profiles start
+// from an empty table and insert into it, the others reserve it first.
+
+struct HashMapProfile
+{
+  const char * name;
+  unsigned read, write, erase; // percent of the operations
+  unsigned hit;                // percent of the reads for present keys
+  double load;                 // load factor after the initial inserts
+  bool reserve;                // false: start empty and grow
+};
+
+// Parses read/write/erase,hit,load[,grow], e.g. 80/15/5,90,0.75. With grow
+// the load factor is where the table ends up, the given one is not used.
+bool ParseHashMapProfile ( const char * spec, HashMapProfile & profile );
+
+// Probe statistics of a set of lookups, all hits or all misses. A good
+// hash spreads the keys so that few lookups probe a second group, and its
+// H2 tags match another key in a probed group with 1/128 probability.
+
+struct HashMapProbeStats
+{
+  HashMapProbeStats ( ) : lookups(0), falsematches(0), full(0)
+  {
+  }
+
+  double Mean ( ) const;
+  size_t Percentile ( double p ) const; // of the groups probed
+  size_t Max ( ) const { return groups.empty() ? 0 : groups.size() - 1; }
+
+  size_t lookups;
+  size_t falsematches;
+  size_t full;
+  std::vector<size_t> groups;   // lookups by the number of groups probed
+  std::vector<size_t> homefill; // lookups by the full slots of the first group
+};
+
+// Probes keys[first], keys[first + step], ... count keys. Keys whose
+// presence differs from hits are left out, the erased ones of a hit set.
+
+template < typename maptype >
+void HashMapProbes ( const maptype & map, const std::vector<HashMapKey> & keys,
+                     size_t first, size_t step, size_t count, bool hits,
+                     HashMapProbeStats & stats )
+{
+  typedef phmap::container_internal::RawHashSetTestOnlyAccess access;
+  stats = HashMapProbeStats();
+  stats.homefill.resize(access::kWidth + 1);
+  for (size_t i = 0; i < count; i++) {
+    const HashMapKey & key = keys[first + i * step];
+    if ((map.find(key) != map.end()) != hits)
+      continue;
+    typename access::Probe probe = access::Find(map, key);
+    if (probe.groups >= stats.groups.size())
+      stats.groups.resize(probe.groups + 1);
+    stats.groups[probe.groups]++;
+    stats.homefill[probe.homefill]++;
+    stats.falsematches += probe.falsematches;
+    stats.full += probe.full;
+    stats.lookups++;
+  }
+}
+
+// Prints the distribution of the groups probed, the home group fill and
+// the H2 false matches against those of uniform tags
+
+void HashMapProbeReport ( const HashMapProbeStats & stats, bool hits );
+
+// Fills a phmap::flat_hash_map with the words and probes each of them and
+// as many missing keys, the words with a 0x01 byte prepended
+
+template < typename hasher_t >
+void HashMapProbeTest ( const hasher_t & hasher, const HashMapWords & words )
+{
+  phmap::flat_hash_map<HashMapKey, int, hasher_t, HashMapKeyEq> map(words.size(), hasher);
+  std::vector<HashMapKey> missing;
+  std::string arena;
+  HashMapProbeStats hits, misses;
+
+  for (size_t i = 0; i < words.size(); i++)
+    map.insert(std::make_pair(words.keys[i], 1));
+
+  arena.reserve(words.bytes + words.size());
+  for (size_t i = 0; i < words.size(); i++) {
+    arena.push_back('\x01');
+    arena.append(words.keys[i].ptr, words.keys[i].len);
+  }
+  missing.reserve(words.size());
+  for (size_t i = 0, pos = 0; i < words.size(); pos += words.keys[i].len + 1, i++)
+    missing.push_back(HashMapKey(arena.data() + pos, words.keys[i].len + 1));
+
+  HashMapProbes(map, words.keys, 0, 1, words.size(), true, hits);
+  HashMapProbes(map, missing, 0, 1, missing.size(), false, misses);
+  printf("\nphmap probes, load factor %0.3f\n", map.load_factor());
+  HashMapProbeReport(hits, true);
+  HashMapProbeReport(misses, false);
+}
+
+template < typename hashtype, typename hashfn >
+void HashMapProfileTest ( hashfn hash, const HashMapWords & words,
+                          const HashMapProfile * custom )
+{
+  typedef HashMapHasher<hashtype, hashfn> hasher_t;
+  typedef phmap::flat_hash_map<HashMapKey, int, hasher_t, HashMapKeyEq> maptype;
+  typedef phmap::container_internal::RawHashSetTestOnlyAccess access;
+  static const HashMapProfile profiles[] =
+  {
+    { "hit",    100,  0,  0, 100, 0.25,  true },
+    { "hit",    100,  0,  0, 100, 0.5,   true },
+    { "hit",    100,  0,  0, 100, 0.75,  true },
+    { "hit",    100,  0,  0, 100, 0.875, true },
+    { "miss",   100,  0,  0,   0, 0.25,  true },
+    { "miss",   100,  0,  0,   0, 0.5,   true },
+    { "miss",   100,  0,  0,   0, 0.75,  true },
+    { "miss",   100,  0,  0,   0, 0.875, true },
+    { "mixed",   70, 20, 10,  50, 0.75,  true },
+    { "churn",   50, 25, 25,  50, 0.875, true },
+    { "growth",  50, 50,  0,  90, 0.0,   false },
+  };
+  const size_t nops = 1 << 20;
+  const int runs = 3;
+  Rand r(82762); // the seed of HashMapSpeedTest
+  const uint32_t seed = r.rand_u32();
+  const hasher_t hasher(hash, seed);
+  const size_t npool = words.size() / 2; // present keys are even, missing odd
+
+  if (npool < 16) {
+    printf("Hashmap profiles - too few keys, SKIP\n");
+    return;
+  }
+
+  printf("phmap::flat_hash_map, %zu keys\n", words.size());
+  printf("Profile  read/write/erase  hit%%  found  load  final  -  cycles/op  "
+         "hit probes avg/max  miss probes avg/max  miss H2 false  deleted\n");
+
+  const size_t nprofiles = sizeof(profiles) / sizeof(profiles[0]) + (custom ? 1 : 0);
+  for (size_t p = 0; p < nprofiles; p++) {
+    const HashMapProfile & profile = p < nprofiles - (custom ? 1 : 0) ? profiles[p] : *custom;
+
+    // present keys: those reaching the load factor in a reserved table
+    size_t capacity = 15, present = npool;
+    if (profile.reserve) {
+      while (profile.load * (2 * capacity + 1) <= npool)
+        capacity = 2 * capacity + 1;
+      present = (size_t)(profile.load * capacity);
+    }
+
+    // the operations, key index << 2 | 0 read, 1 write, 2 erase
+    std::vector<uint64_t> ops(nops);
+    size_t reads = 0;
+    for (size_t i = 0; i < nops; i++) {
+      unsigned op = r.rand_u32() % 100;
+      uint64_t key;
+      if (op < profile.read) {
+        if (r.rand_u32() % 100 < profile.hit)
+          key = 2 * (r.rand_u64() % present);
+        else
+          key = 2 * (r.rand_u64() % npool) + 1;
+        ops[i] = key << 2;
+        reads++;
+      } else {
+        key = 2 * (r.rand_u64() % present);
+        ops[i] = key << 2 | (op < profile.read + profile.write ? 1 : 2);
+      }
+    }
+
+    // the same for every run, the table starts over
+    double best = 0;
+    size_t found = 0;
+    maptype map(0, hasher);
+    for (int run = 0; run < runs; run++) {
+      // clear() keeps tables of up to 127 slots, rehash(0) frees them too
+      map.clear();
+      map.rehash(0);
+      if (profile.reserve) {
+        map.reserve(capacity * 7 / 8);
+        for (size_t i = 0; i < present; i++)
+          map.insert(std::make_pair(words.keys[2 * i], 1));
+      }
+
+      volatile int64_t begin, end;
+      found = 0;
+      begin = timer_start();
+      for (size_t i = 0; i < nops; i++) {
+        const HashMapKey & key = words.keys[ops[i] >> 2];
+        switch (ops[i] & 3) {
+        case 0: found += map.find(key) != map.end(); break;
+        case 1: map.insert(std::make_pair(key, 1)); break;
+        case 2: map.erase(key); break;
+        }
+      }
+      end = timer_end();
+      double t = (double)(end - begin) / (double)nops;
+      if (run == 0 || t < best) best = t;
+    }
+
+    HashMapProbeStats hits, misses;
+    HashMapProbes(map, words.keys, 0, 2, present, true, hits);
+    HashMapProbes(map, words.keys, 1, 2, npool, false, misses);
+    char mix[32], load[8];
+    snprintf(mix, sizeof(mix), "%u/%u/%u", profile.read, profile.write, profile.erase);
+    if (profile.reserve)
+      snprintf(load, sizeof(load), "%5.3f", profile.load);
+    else
+      snprintf(load, sizeof(load), " grow");
+    printf("%-7s  %-16s  %4u  %5.1f  %s  %5.3f  -  %9.2f  %10.2f/%-5zu  %11.2f/%-5zu  %13.4f  %6.2f%%\n",
+           profile.name, mix, profile.hit, reads ? 100.0 * found / reads : 0.0,
+           load, map.load_factor(), best,
+           hits.Mean(), hits.Max(), misses.Mean(), misses.Max(),
+           misses.lookups ? (double)misses.falsematches / misses.lookups : 0.0,
+           map.capacity() ? 100.0 * access::Deleted(map) / map.capacity() : 0.0);
+    fflush(NULL);
+  }
+}
+
+//-----------------------------------------------------------------------------
+// One phmap::parallel_flat_hash_map shared by 1, 2, 4, ... threads, each
+// pinned to its own CPU and doing a mix of finds, inserts and erases on
+// random keys. Every operation locks one of the 16 submaps, chosen by bits
+// of the hash, so a hash which fills the submaps unevenly shows up as lock
+// contention. The occupancy skew is that of all keys over the submaps.
+
+template < typename hashtype, typename hashfn >
+void HashMapConcurrentTest ( hashfn hash, const HashMapWords & words,
+                             unsigned maxthreads )
+{
+  typedef HashMapHasher<hashtype, hashfn> hasher_t;
+  typedef phmap::parallel_flat_hash_map<HashMapKey, int, hasher_t, HashMapKeyEq,
+    std::allocator<std::pair<const HashMapKey, int> >, 4, std::mutex> maptype;
+  Rand r(82762); // the seed of HashMapSpeedTest
+  const uint32_t seed = r.rand_u32();
+  const hasher_t hasher(hash, seed);
+  const double duration = 0.25;
+  const size_t n = words.size();
+
+  const struct { const char * name; unsigned find, insert; } mixes[] =
+  {
+    { "90/5/5",   90,  5 },
+    { "50/25/25", 50, 25 },
+    { "10/45/45", 10, 45 },
+  };
+
+  if (n < 2) {
+    printf("Concurrent hashmap - no keys, SKIP\n");
+    return;
+  }
+
+  std::vector<int> cpus;
+  AvailableCPUs(cpus);
+  unsigned ncpu = (unsigned)cpus.size();
+  if (maxthreads && maxthreads < ncpu) ncpu = maxthreads;
+
+  std::vector<unsigned> counts;
+  for (unsigned t = 1; t < ncpu; t *= 2) counts.push_back(t);
+  counts.push_back(ncpu);
+
+  printf("Concurrent parallel_flat_hash_map - %zu submaps, std::mutex\n",
+         maptype::subcnt());
+  { // submap occupancy
+    maptype map(0, hasher);
+    std::vector<size_t> occupancy(maptype::subcnt());
+    for (size_t i = 0; i < n; i++)
+      occupancy[maptype::subidx(map.hash(words.keys[i]))]++;
+    std::sort(occupancy.begin(), occupancy.end());
+    double mean = (double)n / maptype::subcnt();
+    printf("Submap occupancy of %zu keys - max %5.3f, min %5.3f of the mean\n",
+           n, occupancy.back() / mean, occupancy.front() / mean);
+  }
+  printf("find/insert/erase  Threads  -     Mops/s  per thread  efficiency\n");
+
+  for (size_t m = 0; m < sizeof(mixes) / sizeof(mixes[0]); m++) {
+    double base = 0;
+
+    for (size_t c = 0; c < counts.size(); c++) {
+      const unsigned nthreads = counts[c];
+      maptype map(n, hasher);
+      // half of the keys, so that finds hit about half of the time
+      for (size_t i = 0; i < n; i += 2)
+        map.insert(std::make_pair(words.keys[i], 1));
+
+      std::vector<uint64_t> ops(nthreads * 8); // own cache line each
+      std::atomic<unsigned> ready(0);
+      std::atomic<bool> go(false), stop(false);
+
+      auto worker = [&] ( unsigned t ) {
+        PinThread(cpus[t % cpus.size()]);
+        uint64_t x = seed ^ (0x9E3779B97F4A7C15ULL * (t + 1));
+        uint64_t done = 0, found = 0;
+        ready++;
+        while (!go.load()) std::this_thread::yield();
+        while (!stop.load(std::memory_order_relaxed)) {
+          for (int j = 0; j < 256; j++) {
+            x ^= x << 13; x ^= x >> 7; x ^= x << 17; // xorshift64
+            const HashMapKey & key = words.keys[(x >> 32) % n];
+            unsigned op = (unsigned)(x & 0xffff) % 100;
+            if (op < mixes[m].find)
+              found += map.contains(key);
+            else if (op < mixes[m].find + mixes[m].insert)
+              map.insert(std::make_pair(key, 1));
+            else
+              map.erase(key);
+          }
+          done += 256;
+        }
+        ops[t * 8] = done;
+        ops[t * 8 + 1] = found;
+      };
+
+      std::vector<std::thread> threads;
+      for (unsigned t = 0; t < nthreads; t++)
+        threads.push_back(std::thread(worker, t));
+      while (ready.load() < nthreads) std::this_thread::yield();
+
+      std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+      go = true;
+      std::this_thread::sleep_for(std::chrono::duration<double>(duration));
+      stop = true;
+      for (unsigned t = 0; t < nthreads; t++)
+        threads[t].join();
+      std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+      double total = 0;
+      for (unsigned t = 0; t < nthreads; t++) total += (double)ops[t * 8];
+      double rate = total / std::chrono::duration<double>(t1 - t0).count() / 1e6;
+      if (c == 0) base = rate;
+
+      printf("%-17s  %7u  -  %9.3f  %10.3f      %5.1f%%\n", mixes[m].name,
+             nthreads, rate, rate / nthreads, 100.0 * rate / (nthreads * base));
+      fflush(NULL);
+    }
+  }
+}
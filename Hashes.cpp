@@ -175,6 +175,52 @@ FNV32a(const void *key, int len, uint32_t seed)
   return h;
 }
 
+// FNV1a on a batch of keys. Groups of 4 keys go through their common
+// length in lockstep, so the multiply chains of the keys overlap.
+void
+FNV32a_batch(const void *const *keys, const int *lens, uint32_t seed,
+             void *outs, int n)
+{
+  uint32_t *out = (uint32_t *)outs;
+  int k = 0;
+
+  for (; k + 4 <= n; k += 4) {
+    const uint8_t *d0 = (const uint8_t *)keys[k];
+    const uint8_t *d1 = (const uint8_t *)keys[k + 1];
+    const uint8_t *d2 = (const uint8_t *)keys[k + 2];
+    const uint8_t *d3 = (const uint8_t *)keys[k + 3];
+    uint32_t h0 = seed ^ UINT32_C(2166136261);
+    uint32_t h1 = h0, h2 = h0, h3 = h0;
+    int common = lens[k];
+    int i;
+
+    for (i = 1; i < 4; i++)
+      if (lens[k + i] < common)
+        common = lens[k + i];
+    for (i = 0; i < common; i++) {
+      h0 = (h0 ^ d0[i]) * 16777619;
+      h1 = (h1 ^ d1[i]) * 16777619;
+      h2 = (h2 ^ d2[i]) * 16777619;
+      h3 = (h3 ^ d3[i]) * 16777619;
+    }
+    for (i = common; i < lens[k]; i++)
+      h0 = (h0 ^ d0[i]) * 16777619;
+    for (i = common; i < lens[k + 1]; i++)
+      h1 = (h1 ^ d1[i]) * 16777619;
+    for (i = common; i < lens[k + 2]; i++)
+      h2 = (h2 ^ d2[i]) * 16777619;
+    for (i = common; i < lens[k + 3]; i++)
+      h3 = (h3 ^ d3[i]) * 16777619;
+
+    out[k] = h0;
+    out[k + 1] = h1;
+    out[k + 2] = h2;
+    out[k + 3] = h3;
+  }
+  for (; k < n; k++)
+    out[k] = FNV32a(keys[k], lens[k], seed);
+}
+
 // objsize: 0xe30-0xf71: 321
 uint32_t
 FNV32a_YoshimitsuTRIAD(const char *key, int len, uint32_t seed)
@@ -549,7 +595,6 @@ extern "C" {
   void		  hasshe2 (const void *input, int len, uint32_t seed, void *out);
 #endif
 #if defined(__SSE4_2__) && defined(__x86_64__)
-  uint32_t	  crc32c_hw(const void *input, int len, uint32_t seed);
   uint32_t	  crc32c(const void *input, int len, uint32_t seed);
   uint64_t	  crc64c_hw(const void *input, int len, uint32_t seed);
 #endif
@@ -573,19 +618,9 @@ hasshe2_test(const void *input, int len, uint32_t seed, void *out)
 #endif
 
 #if defined(__SSE4_2__) && (defined(__i686__) || defined(_M_IX86) || defined(__x86_64__))
-/* Compute CRC-32C using the Intel hardware instruction.
+/* crc32c_hw_test, the hardware CRC-32C, is inline in Hashes.h.
    TODO: arm8
  */
-void
-crc32c_hw_test(const void *input, int len, uint32_t seed, void *out)
-{
-  if (!len) {
-    *(uint32_t *) out = 0;
-    return;
-  }
-  // objsize: 0-28d: 653
-  *(uint32_t *) out = crc32c_hw(input, len, seed);
-}
 /* Faster Adler SSE4.2 crc32 in HW */
 void
 crc32c_hw1_test(const void *input, int len, uint32_t seed, void *out)
@@ -50,7 +50,44 @@ void crc32(const void *key, int len, uint32_t seed, void *out);
 void hasshe2_test(const void *key, int len, uint32_t seed, void *out);
 #endif
 #if defined(__SSE4_2__) && defined(__x86_64__)
-void crc32c_hw_test(const void *key, int len, uint32_t seed, void *out);
+#include <smmintrin.h>
+/* CRC-32C using the SSE4.2 crc32 instruction, defined here so that the
+   inlined tests can inline it. crc64c_hw() is in crc32_hw.c */
+inline void crc32c_hw_test(const void *key, int len, uint32_t seed, void *out)
+{
+  const uint8_t *buf = (const uint8_t *)key;
+  uint32_t crc = seed ^ 0xFFFFFFFF;
+
+  if (!len) {
+    *(uint32_t *) out = 0;
+    return;
+  }
+  // align the input to the word boundary
+  for (; len > 0 && ((size_t)buf & 7); len--, buf++)
+    crc = _mm_crc32_u8(crc, *buf);
+  uint64_t crc64 = crc;
+  for (; len >= 8; len -= 8, buf += 8) {
+    uint64_t w;
+    memcpy(&w, buf, 8);
+    crc64 = _mm_crc32_u64(crc64, w);
+  }
+  crc = (uint32_t)crc64;
+  if (len >= 4) {
+    uint32_t w;
+    memcpy(&w, buf, 4);
+    crc = _mm_crc32_u32(crc, w);
+    len -= 4, buf += 4;
+  }
+  if (len >= 2) {
+    uint16_t w;
+    memcpy(&w, buf, 2);
+    crc = _mm_crc32_u16(crc, w);
+    len -= 2, buf += 2;
+  }
+  if (len)
+    crc = _mm_crc32_u8(crc, *buf);
+  *(uint32_t *) out = crc ^ 0xFFFFFFFF;
+}
 void crc32c_hw1_test(const void *key, int len, uint32_t seed, void *out);
 void crc64c_hw_test(const void *key, int len, uint32_t seed, void *out);
 #endif
@@ -105,6 +142,8 @@ uint32_t FNV32a(const void *key, int len, uint32_t seed);
 inline void FNV32a_test(const void *key, int len, uint32_t seed, void *out) {
   *(uint32_t *)out = FNV32a((const char *)key, len, seed);
 }
+void FNV32a_batch(const void *const *keys, const int *lens, uint32_t seed,
+                  void *outs, int n);
 uint32_t FNV32a_YoshimitsuTRIAD(const char *key, int len, uint32_t seed);
 inline void FNV32a_YT_test(const void *key, int len, uint32_t seed, void *out) {
   *(uint32_t *)out = FNV32a_YoshimitsuTRIAD((const char *)key, len, seed);
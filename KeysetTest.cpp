@@ -225,6 +225,71 @@ void AppendedZeroesTest ( pfHash hash, const int hashbits )
   printf(" PASS\n");
 }
 
+//----------------------------------------------------------------------------
+// A native batch hash must give the same results as hashing the keys one at
+// a time, for any mix of key lengths and alignments in the batch
+
+bool BatchSanityTest ( pfHash hash, pfHashBatch batch, const int hashbits )
+{
+  printf("Running BatchSanityTest    ");
+
+  Rand r(462571);
+
+  bool result = true;
+
+  const int hashbytes = hashbits/8;
+  const int maxbatch = 64;
+  const int keymax = 256;
+  const int pad = 16;
+
+  uint8_t * buffer = new uint8_t[maxbatch * (keymax + pad)];
+  uint8_t * hashes1 = new uint8_t[maxbatch * hashbytes];
+  uint8_t * hashes2 = new uint8_t[maxbatch * hashbytes];
+
+  const void * keys[maxbatch];
+  int lens[maxbatch];
+
+  for(int rep = 0; rep < 1000; rep++)
+  {
+    if(rep % 100 == 0) printf(".");
+
+    const int n = r.rand_u32() % (maxbatch + 1);
+    const uint32_t seed = r.rand_u32();
+
+    r.rand_p(buffer, maxbatch * (keymax + pad));
+
+    for(int i = 0; i < n; i++)
+    {
+      keys[i] = &buffer[i * (keymax + pad) + r.rand_u32() % pad];
+      lens[i] = (rep & 1) ? (int)(r.rand_u32() % (keymax + 1)) : rep % 64;
+      hash(keys[i], lens[i], seed, &hashes1[i * hashbytes]);
+    }
+
+    batch(keys, lens, seed, hashes2, n);
+
+    if(memcmp(hashes1, hashes2, n * hashbytes) != 0)
+    {
+      result = false;
+      break;
+    }
+  }
+
+  if(result == false)
+  {
+    printf(" FAIL  !!!!!\n");
+  }
+  else
+  {
+    printf(" PASS\n");
+  }
+
+  delete [] buffer;
+  delete [] hashes1;
+  delete [] hashes2;
+
+  return result;
+}
+
 //-----------------------------------------------------------------------------
 // Generate all keys of up to N bytes containing two non-zero bytes
 
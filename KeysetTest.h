@@ -10,6 +10,7 @@
 #include "Types.h"
 #include "Stats.h"
 #include "Random.h"   // for rand_p
+#include "Parallel.h"
 
 #include <algorithm>  // for std::swap
 #include <assert.h>
@@ -20,6 +21,48 @@
 bool VerificationTest   ( pfHash hash, const int hashbits, uint32_t expected, bool verbose );
 bool SanityTest         ( pfHash hash, const int hashbits );
 void AppendedZeroesTest ( pfHash hash, const int hashbits );
+bool BatchSanityTest    ( pfHash hash, pfHashBatch batch, const int hashbits );
+
+//-----------------------------------------------------------------------------
+// Keys queued up and fed to the hash's batch interface, KeyBatch::size at a
+// time. The hashes go to consecutive slots starting at out, flush() hashes
+// what is left over.
+
+template < typename hashtype, typename hashfn >
+class KeyBatch
+{
+public:
+
+  enum { size = 16 };
+
+  KeyBatch ( hashfn & hash, int maxlen, hashtype * out = NULL )
+  : m_hash(hash), m_buf(size * maxlen), m_out(out), m_count(0)
+  {
+    for(int i = 0; i < size; i++) m_keys[i] = &m_buf[i * maxlen];
+  }
+
+  inline void add ( const void * key, int len )
+  {
+    memcpy((void*)m_keys[m_count], key, len);
+    m_lens[m_count] = len;
+
+    if(++m_count == size) flush();
+  }
+
+  inline void flush ( void )
+  {
+    m_hash.batch(m_keys, m_lens, 0, m_out, m_count);
+    m_out += m_count;
+    m_count = 0;
+  }
+
+  hashfn & m_hash;
+  std::vector<uint8_t> m_buf;
+  const void * m_keys[size];
+  int m_lens[size];
+  hashtype * m_out;
+  int m_count;
+};
 
 //-----------------------------------------------------------------------------
 // Keyset 'Combination' - all possible combinations of input blocks
@@ -34,10 +77,10 @@ static void printKey(const void* key, size_t len)
     for (s=0; s<len; s+=8) printf("%-16zu", s);
 }
 
-template< typename hashtype, class blocktype >
+template< typename hashtype, class blocktype, typename hashfn >
 void CombinationKeygenRecurse ( blocktype * key, int len, int maxlen,
                   blocktype * blocks, int blockcount,
-                  pfHash hash, std::vector<hashtype> & hashes )
+                  hashfn hash, std::vector<hashtype> & hashes )
 {
   if(len == maxlen) return;  // end recursion
 
@@ -59,13 +102,83 @@ void CombinationKeygenRecurse ( blocktype * key, int len, int maxlen,
   }
 }
 
+// The keys above are numbered in the order the recursion generates them,
+// a preorder walk of the tree of blockcount^maxlen leaves. A subtree with
+// r levels has nodes(r) = 1 + blockcount * nodes(r-1) keys, so the key with
+// a given number can be found directly, and any range of keys generated
+// without the keys before it.
+
+static inline uint64_t CombinationSubtreeSize ( int levels, int blockcount )
+{
+  uint64_t size = 0;
+  for(int r = 0; r < levels; r++) size = 1 + blockcount * size;
+  return size;
+}
+
+static inline uint64_t CombinationKeycount ( int maxlen, int blockcount )
+{
+  return blockcount * CombinationSubtreeSize(maxlen, blockcount);
+}
+
+// Hash the keys [begin, end) into consecutive slots starting at out
+
+template< typename hashtype, class blocktype, typename hashfn >
+void CombinationKeygenRange ( uint64_t begin, uint64_t end, int maxlen,
+                              blocktype * blocks, int blockcount,
+                              hashfn hash, hashtype * out )
+{
+  if(begin >= end) return;
+
+  std::vector<blocktype> key(maxlen);
+  std::vector<int> digit(maxlen);
+  int len = 0;
+
+  // find key number begin
+
+  uint64_t index = begin;
+
+  for(;;)
+  {
+    uint64_t size = CombinationSubtreeSize(maxlen - len, blockcount);
+
+    digit[len] = (int)(index / size);
+    key[len] = blocks[digit[len]];
+    index %= size;
+    len++;
+
+    if(index == 0) break;
+    index--;
+  }
+
+  // hash, then step to the next key in preorder
+
+  for(uint64_t i = begin; i < end; i++)
+  {
+    hash(&key[0], len * sizeof(blocktype), 0, out++);
+
+    if(len < maxlen)
+    {
+      digit[len] = 0;
+      key[len] = blocks[0];
+      len++;
+      continue;
+    }
+
+    while(len > 0 && ++digit[len-1] == blockcount) len--;
+
+    if(len == 0) break;
+
+    key[len-1] = blocks[digit[len-1]];
+  }
+}
+
 typedef struct { char c[16]; } block16;
 typedef struct { char c[32]; } block32;
 typedef struct { char c[64]; } block64;
 typedef struct { char c[128]; } block128;
 
-template< typename hashtype, typename blocktype >
-bool CombinationKeyTest ( hashfunc<hashtype> hash, int maxlen, blocktype* blocks,
+template< typename hashtype, typename blocktype, typename hashfn >
+bool CombinationKeyTest ( hashfn hash, int maxlen, blocktype* blocks,
                           int blockcount, bool testColl, bool testDist, bool drawDiagram )
 {
   printf("Keyset 'Combination' - up to %d blocks from a set of %d - ",maxlen,blockcount);
@@ -74,11 +187,30 @@ bool CombinationKeyTest ( hashfunc<hashtype> hash, int maxlen, blocktype* blocks
 
   std::vector<hashtype> hashes;
 
-  blocktype * key = new blocktype[maxlen];
+  if(g_NCPU <= 1)
+  {
+    blocktype * key = new blocktype[maxlen];
 
-  CombinationKeygenRecurse(key,0,maxlen,blocks,blockcount,hash,hashes);
+    CombinationKeygenRecurse(key,0,maxlen,blocks,blockcount,hash,hashes);
 
-  delete [] key;
+    delete [] key;
+  }
+  else
+  {
+    // every thread generates and hashes its own chunks of keys
+    const uint64_t keycount = CombinationKeycount(maxlen, blockcount);
+    const uint64_t chunk = 65536;
+
+    hashes.resize(keycount);
+
+    ParallelFor((keycount + chunk - 1) / chunk, g_NCPU, [&] ( size_t i, unsigned )
+    {
+      uint64_t begin = i * chunk;
+      uint64_t end = std::min(begin + chunk, keycount);
+
+      CombinationKeygenRange(begin, end, maxlen, blocks, blockcount, hash, &hashes[begin]);
+    });
+  }
 
   printf("%d keys\n",(int)hashes.size());
 
@@ -99,8 +231,8 @@ bool CombinationKeyTest ( hashfunc<hashtype> hash, int maxlen, blocktype* blocks
 // Keyset 'Permutation' - given a set of 32-bit blocks, generate keys
 // consisting of all possible permutations of those blocks
 
-template< typename hashtype >
-void PermutationKeygenRecurse ( pfHash hash, uint32_t * blocks, int blockcount, int k, std::vector<hashtype> & hashes )
+template< typename hashtype, typename hashfn >
+void PermutationKeygenRecurse ( hashfn hash, uint32_t * blocks, int blockcount, int k, std::vector<hashtype> & hashes )
 {
   if(k == blockcount-1)
   {
@@ -123,8 +255,8 @@ void PermutationKeygenRecurse ( pfHash hash, uint32_t * blocks, int blockcount,
   }
 }
 
-template< typename hashtype >
-bool PermutationKeyTest ( hashfunc<hashtype> hash, uint32_t * blocks, int blockcount, bool testColl, bool testDist, bool drawDiagram )
+template< typename hashtype, typename hashfn >
+bool PermutationKeyTest ( hashfn hash, uint32_t * blocks, int blockcount, bool testColl, bool testDist, bool drawDiagram )
 {
   printf("Keyset 'Permutation' - %d blocks - ",blockcount);
 
@@ -164,37 +296,94 @@ static void printSparseKey(const void* buffer, size_t size)
     }
 }
 
-template < typename keytype, typename hashtype >
-void SparseKeygenRecurse ( pfHash hash, int start, int bitsleft, bool inclusive, keytype & k, std::vector<hashtype> & hashes )
+template < typename keytype, typename hashtype, typename hashfn >
+void SparseKeygenRecurse ( int start, int bitsleft, bool inclusive, keytype & k,
+                           KeyBatch<hashtype,hashfn> & batch )
 {
   const int nbytes = sizeof(keytype);
   const int nbits = nbytes * 8;
 
-  hashtype h;
-
   for(int i = start; i < nbits; i++)
   {
     flipbit(&k, nbytes, i);
 
     if(inclusive || (bitsleft == 1))
     {
-      hash(&k, sizeof(keytype), 0, &h);
-      hashes.push_back(h);
+      batch.add(&k, sizeof(keytype));
     }
 
     if(bitsleft > 1)
     {
-      SparseKeygenRecurse(hash, i+1, bitsleft-1, inclusive, k, hashes);
+      SparseKeygenRecurse(i+1, bitsleft-1, inclusive, k, batch);
     }
 
     flipbit(&k, nbytes, i);
   }
 }
 
+// Number of keys SparseKeygenRecurse generates for the bits [start, nbits)
+
+static inline uint64_t SparseKeycount ( int nbits, int start, int bitsleft, bool inclusive )
+{
+  const uint64_t n = nbits - start;
+  uint64_t choose = 1;  // n choose j
+  uint64_t count = 0;
+
+  for(int j = 1; j <= bitsleft && (uint64_t)j <= n; j++)
+  {
+    choose = choose * (n - j + 1) / j;
+    if(inclusive || j == bitsleft) count += choose;
+  }
+
+  return count;
+}
+
+// The recursion split into independent subtrees. A subtree is identified by
+// its fixed prefix of the lowest set bits and owns a contiguous range of the
+// hashes, in the same order the serial recursion produces them.
+
+struct SparseSubtree
+{
+  int      prefix[2];
+  int      depth;
+  bool     recurse;
+  uint64_t offset;
+};
+
+static inline void SparseSubtrees ( int nbits, int setbits, bool inclusive, uint64_t offset,
+                                    std::vector<SparseSubtree> & subtrees )
+{
+  // 2-bit prefixes only pay off with enough bits left below them
+  const int depth = setbits > 2 ? 2 : 1;
+
+  for(int i = 0; i < nbits; i++)
+  {
+    SparseSubtree t = { { i, -1 }, 1, depth == 1, offset };
+    subtrees.push_back(t);
+
+    if(inclusive || setbits == 1) offset++;
+
+    if(depth == 1)
+    {
+      offset += SparseKeycount(nbits, i+1, setbits-1, inclusive);
+      continue;
+    }
+
+    for(int j = i+1; j < nbits; j++)
+    {
+      SparseSubtree u = { { i, j }, 2, true, offset };
+      subtrees.push_back(u);
+
+      if(inclusive || setbits == 2) offset++;
+      offset += SparseKeycount(nbits, j+1, setbits-2, inclusive);
+    }
+  }
+}
+
 //----------
 
-template < int keybits, typename hashtype >
-bool SparseKeyTest ( hashfunc<hashtype> hash, const int setbits, bool inclusive,
+template < int keybits, typename hashtype, typename hashfn >
+bool SparseKeyTest ( hashfn hash, const int setbits, bool inclusive,
                      bool testColl, bool testDist, bool drawDiagram )
 {
   printf("Keyset 'Sparse' - %d-bit keys with %s %d bits set - ",keybits,
@@ -213,7 +402,44 @@ bool SparseKeyTest ( hashfunc<hashtype> hash, const int setbits, bool inclusive,
     hash(&k,sizeof(keytype),0,&hashes[0]);
   }
 
-  SparseKeygenRecurse(hash,0,setbits,inclusive,k,hashes);
+  const size_t first = hashes.size();
+
+  hashes.resize(first + SparseKeycount(keybits, 0, setbits, inclusive));
+
+  if(g_NCPU <= 1)
+  {
+    KeyBatch<hashtype,hashfn> batch(hash, sizeof(keytype), &hashes[first]);
+
+    SparseKeygenRecurse(0,setbits,inclusive,k,batch);
+
+    batch.flush();
+  }
+  else
+  {
+    // hash the subtrees into their preallocated slots on all CPUs
+    std::vector<SparseSubtree> subtrees;
+    SparseSubtrees(keybits, setbits, inclusive, first, subtrees);
+
+    ParallelFor(subtrees.size(), g_NCPU, [&] ( size_t i, unsigned )
+    {
+      const SparseSubtree & t = subtrees[i];
+      keytype key;
+      memset(&key,0,sizeof(key));
+
+      for(int d = 0; d < t.depth; d++)
+        flipbit(&key, sizeof(keytype), t.prefix[d]);
+
+      KeyBatch<hashtype,hashfn> batch(hash, sizeof(keytype), &hashes[t.offset]);
+
+      if(inclusive || setbits == t.depth)
+        batch.add(&key, sizeof(keytype));
+
+      if(t.recurse && setbits > t.depth)
+        SparseKeygenRecurse(t.prefix[t.depth-1]+1, setbits-t.depth, inclusive, key, batch);
+
+      batch.flush();
+    });
+  }
 
   printf("%d keys\n",(int)hashes.size());
 
@@ -230,8 +456,8 @@ bool SparseKeyTest ( hashfunc<hashtype> hash, const int setbits, bool inclusive,
 // Keyset 'Window' - for all possible N-bit windows of a K-bit key, generate
 // all possible keys with bits set in that window
 
-template < typename keytype, typename hashtype >
-bool WindowedKeyTest ( hashfunc<hashtype> hash, int windowbits,
+template < typename keytype, typename hashtype, typename hashfn >
+bool WindowedKeyTest ( hashfn hash, int windowbits,
                        bool testCollision, bool testDistribution, bool drawDiagram )
 {
   const int keybits = sizeof(keytype) * 8;
@@ -260,15 +486,18 @@ bool WindowedKeyTest ( hashfunc<hashtype> hash, int windowbits,
   {
     int minbit = j;
     keytype key;
+    KeyBatch<hashtype,hashfn> batch(hash, sizeof(keytype), &hashes[0]);
 
     for(int i = 0; i < keycount; i++)
     {
       key = i;
       //key = key << minbit;
       lrot(&key,sizeof(keytype),minbit);
-      hash(&key,sizeof(keytype),0,&hashes[i]);
+      batch.add(&key,sizeof(keytype));
     }
 
+    batch.flush();
+
     printf("Window at %3d - ",j);
     result &= TestHashList(hashes, drawDiagram, testCollision, testDistribution,
                            /* do not test high/low bits (to not clobber the screen) */
@@ -285,8 +514,8 @@ bool WindowedKeyTest ( hashfunc<hashtype> hash, int windowbits,
 
 // (This keyset type is designed to make MurmurHash2 fail)
 
-template < typename hashtype >
-bool CyclicKeyTest ( pfHash hash, int cycleLen, int cycleReps, const int keycount, bool drawDiagram )
+template < typename hashtype, typename hashfn >
+bool CyclicKeyTest ( hashfn hash, int cycleLen, int cycleReps, const int keycount, bool drawDiagram )
 {
   printf("Keyset 'Cyclic' - %d cycles of %d bytes - %d keys\n",cycleReps,cycleLen,keycount);
 
@@ -334,14 +563,41 @@ bool CyclicKeyTest ( pfHash hash, int cycleLen, int cycleReps, const int keycoun
 
 void TwoBytesKeygen ( int maxlen, KeyCallback & c );
 
-template < typename hashtype >
-bool TwoBytesTest2 ( pfHash hash, int maxlen, bool drawDiagram )
+// Hashes the generated keys in batches, into slots reserved up front
+
+template < typename hashtype, typename hashfn >
+struct BatchHashCallback : public KeyCallback
+{
+  BatchHashCallback ( hashfn & hash, int maxlen, std::vector<hashtype> & hashes )
+  : m_hashes(hashes), m_batch(hash, maxlen)
+  {
+    m_hashes.clear();
+  }
+
+  virtual void operator () ( const void * key, int len )
+  {
+    m_batch.add(key, len);
+  }
+
+  virtual void reserve ( int keycount )
+  {
+    m_hashes.resize(keycount);
+    m_batch.m_out = &m_hashes[0];
+  }
+
+  std::vector<hashtype> & m_hashes;
+  KeyBatch<hashtype,hashfn> m_batch;
+};
+
+template < typename hashtype, typename hashfn >
+bool TwoBytesTest2 ( hashfn hash, int maxlen, bool drawDiagram )
 {
   std::vector<hashtype> hashes;
 
-  HashCallback<hashtype> c(hash,hashes);
+  BatchHashCallback<hashtype,hashfn> c(hash,maxlen,hashes);
 
   TwoBytesKeygen(maxlen,c);
+  c.m_batch.flush();
 
   bool result = true;
 
@@ -356,8 +612,8 @@ bool TwoBytesTest2 ( pfHash hash, int maxlen, bool drawDiagram )
 // where "core" consists of all possible combinations of the given character
 // set of length N.
 
-template < typename hashtype >
-bool TextKeyTest ( hashfunc<hashtype> hash, const char * prefix, const char * coreset, const int corelen, const char * suffix, bool drawDiagram )
+template < typename hashtype, typename hashfn >
+bool TextKeyTest ( hashfn hash, const char * prefix, const char * coreset, const int corelen, const char * suffix, bool drawDiagram )
 {
   const int prefixlen = (int)strlen(prefix);
   const int suffixlen = (int)strlen(suffix);
@@ -412,8 +668,8 @@ bool TextKeyTest ( hashfunc<hashtype> hash, const char * prefix, const char * co
 
 // We reuse one block of empty bytes, otherwise the RAM cost is enormous.
 
-template < typename hashtype >
-bool ZeroKeyTest ( pfHash hash, bool drawDiagram )
+template < typename hashtype, typename hashfn >
+bool ZeroKeyTest ( hashfn hash, bool drawDiagram )
 {
   int keycount = 200*1024;
 
@@ -447,8 +703,8 @@ bool ZeroKeyTest ( pfHash hash, bool drawDiagram )
 //-----------------------------------------------------------------------------
 // Keyset 'Seed' - hash "the quick brown fox..." using different seeds
 
-template < typename hashtype >
-bool SeedTest ( pfHash hash, int keycount, bool drawDiagram )
+template < typename hashtype, typename hashfn >
+bool SeedTest ( hashfn hash, int keycount, bool drawDiagram )
 {
   printf("Keyset 'Seed' - %d keys\n",keycount);
 
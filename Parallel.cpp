@@ -0,0 +1,313 @@
+#include "Parallel.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <thread>
+#include <mutex>
+
+unsigned g_NCPU = 1;
+
+#if defined(_WIN32) && !defined(__CYGWIN__)
+
+//-----------------------------------------------------------------------------
+// No fork() - run the tasks serially
+
+void RunTestTasks ( std::vector<TestTask> & tasks, unsigned /*jobs*/ )
+{
+  for(size_t i = 0; i < tasks.size(); i++)
+  {
+    tasks[i]();
+  }
+}
+
+double ChildCPUSeconds ( void )
+{
+  return 0.0;
+}
+
+#else
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+//-----------------------------------------------------------------------------
+// Run one task in the current process with stdout redirected to out, as if it
+// ran in a worker. Only used when tmpfile() or fork() fails.
+
+static void RunTaskInline ( TestTask & task, FILE * out )
+{
+  fflush(NULL);
+  int savedfd = -1;
+  if(out)
+  {
+    savedfd = dup(STDOUT_FILENO);
+    dup2(fileno(out), STDOUT_FILENO);
+  }
+
+  task();
+
+  fflush(NULL);
+  if(out)
+  {
+    dup2(savedfd, STDOUT_FILENO);
+    close(savedfd);
+  }
+}
+
+static void ReplayOutput ( FILE * out, int status )
+{
+  char buf[4096];
+  size_t len;
+
+  fflush(out);
+  rewind(out);
+
+  while((len = fread(buf, 1, sizeof(buf), out)) > 0)
+  {
+    fwrite(buf, 1, len, stdout);
+  }
+  fclose(out);
+
+  if(WIFSIGNALED(status))
+  {
+    printf("*********FAIL********* test process killed by signal %d\n\n",
+           WTERMSIG(status));
+  }
+  fflush(NULL);
+}
+
+void RunTestTasks ( std::vector<TestTask> & tasks, unsigned jobs )
+{
+  const size_t ntasks = tasks.size();
+
+  if(jobs <= 1 || ntasks <= 1)
+  {
+    for(size_t i = 0; i < ntasks; i++)
+    {
+      tasks[i]();
+    }
+    return;
+  }
+
+  std::vector<FILE*> outs(ntasks, (FILE*)NULL);
+  std::vector<pid_t> pids(ntasks, (pid_t)0);
+  std::vector<int>   status(ntasks, 0);
+  std::vector<bool>  done(ntasks, false);
+
+  // the threads of each worker
+  const unsigned workers = jobs < ntasks ? jobs : (unsigned)ntasks;
+  const unsigned budget = g_NCPU / workers > 1 ? g_NCPU / workers : 1;
+
+  size_t started = 0;
+  size_t printed = 0;
+  unsigned running = 0;
+
+  // don't let the workers inherit and re-print our buffered output
+  fflush(NULL);
+
+  while(printed < ntasks)
+  {
+    while(running < jobs && started < ntasks)
+    {
+      size_t i = started++;
+
+      outs[i] = tmpfile();
+      if(outs[i] == NULL)
+      {
+        // no temp file: wait for everything before us, then run inline
+        perror("tmpfile");
+        while(running)
+        {
+          int st;
+          pid_t pid = wait(&st);
+          if(pid < 0) break;
+          for(size_t j = 0; j < i; j++)
+          {
+            if(pids[j] == pid) { status[j] = st; done[j] = true; running--; }
+          }
+        }
+        for(; printed < i; printed++)
+          ReplayOutput(outs[printed], status[printed]);
+        tasks[i]();
+        done[i] = true;
+        printed++;
+        continue;
+      }
+
+      pid_t pid = fork();
+
+      if(pid == 0)
+      {
+        g_NCPU = budget;
+        dup2(fileno(outs[i]), STDOUT_FILENO);
+        tasks[i]();
+        fflush(NULL);
+        _exit(0);
+      }
+      else if(pid < 0)
+      {
+        perror("fork");
+        RunTaskInline(tasks[i], outs[i]);
+        done[i] = true;
+      }
+      else
+      {
+        pids[i] = pid;
+        running++;
+      }
+    }
+
+    // replay everything that is finished, in order
+    while(printed < started && done[printed])
+    {
+      ReplayOutput(outs[printed], status[printed]);
+      printed++;
+    }
+
+    if(printed == ntasks || running == 0)
+      continue;
+
+    int st;
+    pid_t pid = wait(&st);
+
+    if(pid < 0)
+    {
+      perror("wait");
+      break;
+    }
+
+    for(size_t j = 0; j < started; j++)
+    {
+      if(pids[j] == pid)
+      {
+        status[j] = st;
+        done[j] = true;
+        running--;
+        break;
+      }
+    }
+  }
+}
+
+double ChildCPUSeconds ( void )
+{
+  struct rusage ru;
+
+  if(getrusage(RUSAGE_CHILDREN, &ru) != 0)
+    return 0.0;
+
+  return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec)
+    + (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+void ParallelFor ( size_t n, unsigned nthreads, const ParallelForFunc & fn )
+{
+  if(nthreads > n) nthreads = (unsigned)n;
+
+  if(nthreads <= 1)
+  {
+    for(size_t i = 0; i < n; i++)
+    {
+      fn(i, 0);
+    }
+    return;
+  }
+
+  // the remaining slice [begin, end) of each thread
+
+  struct Slice
+  {
+    std::mutex lock;
+    size_t begin;
+    size_t end;
+  };
+
+  std::vector<Slice> slices(nthreads);
+
+  for(unsigned t = 0; t < nthreads; t++)
+  {
+    slices[t].begin = n * t / nthreads;
+    slices[t].end   = n * (t + 1) / nthreads;
+  }
+
+  auto worker = [&] ( unsigned t )
+  {
+    Slice & mine = slices[t];
+
+    for(;;)
+    {
+      size_t i;
+      bool found = false;
+
+      {
+        std::lock_guard<std::mutex> guard(mine.lock);
+        if(mine.begin < mine.end)
+        {
+          i = mine.begin++;
+          found = true;
+        }
+      }
+
+      if(found)
+      {
+        fn(i, t);
+        continue;
+      }
+
+      // steal the back half of the largest slice
+
+      unsigned victim = t;
+      size_t   most = 0;
+
+      for(unsigned v = 0; v < nthreads; v++)
+      {
+        if(v == t) continue;
+        std::lock_guard<std::mutex> guard(slices[v].lock);
+        size_t left = slices[v].end - slices[v].begin;
+        if(left > most) { most = left; victim = v; }
+      }
+
+      if(victim == t)
+        return;
+
+      size_t begin, end;
+      {
+        std::lock_guard<std::mutex> guard(slices[victim].lock);
+        size_t left = slices[victim].end - slices[victim].begin;
+        if(left == 0) continue;
+        end   = slices[victim].end;
+        begin = end - (left + 1) / 2;
+        slices[victim].end = begin;
+      }
+      {
+        std::lock_guard<std::mutex> guard(mine.lock);
+        mine.begin = begin;
+        mine.end   = end;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+
+  for(unsigned t = 1; t < nthreads; t++)
+  {
+    threads.push_back(std::thread(worker, t));
+  }
+
+  worker(0);
+
+  for(size_t t = 0; t < threads.size(); t++)
+  {
+    threads[t].join();
+  }
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,51 @@
+//-----------------------------------------------------------------------------
+// Parallel execution helpers for the test harness.
+
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <stddef.h>
+
+// Number of CPUs to use, set with --threads=N. 1 runs everything serially.
+
+extern unsigned g_NCPU;
+
+//-----------------------------------------------------------------------------
+// Run a list of independent test tasks on up to jobs CPUs at once.
+//
+// The tests print their results directly with printf, so every task runs in
+// its own forked worker process with stdout redirected into a temp file. The
+// captured output is replayed in task order as soon as all previous tasks
+// have finished, so the log is identical to a serial run. Worker processes
+// also isolate the hashes which keep global state between calls.
+//
+// Falls back to running the tasks one after another if jobs <= 1 or the
+// platform has no fork().
+//
+// The workers share the CPUs: each one runs with g_NCPU divided by the
+// number of workers at once, at least 1, for its ParallelFor loops.
+// Global state a task changes is lost with its worker process.
+
+typedef std::function<void (void)> TestTask;
+
+void RunTestTasks ( std::vector<TestTask> & tasks, unsigned jobs );
+
+// CPU seconds spent by finished worker processes, to be added to clock()
+double ChildCPUSeconds ( void );
+
+//-----------------------------------------------------------------------------
+// Call fn(i, thread) for every i in [0, n) on up to nthreads threads, with
+// thread in [0, nthreads) for per-thread scratch state.
+//
+// Every thread starts with an equal slice of [0, n) and takes indices from
+// the front of it. A thread which runs out steals the back half of the
+// largest remaining slice, so uneven items balance out. The order items are
+// run in is unspecified; fn must only write to locations owned by i or by
+// thread. Runs inline if nthreads <= 1.
+
+typedef std::function<void (size_t i, unsigned thread)> ParallelForFunc;
+
+void ParallelFor ( size_t n, unsigned nthreads, const ParallelForFunc & fn );
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,138 @@
+#include "PerfCounters.h"
+
+#include <stdio.h>
+#include <string.h>
+
+bool g_perf = false;
+
+#if defined(__linux__)
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const struct { uint64_t config; const char * name; } perf_events[PERF_COUNTERS] =
+{
+  { PERF_COUNT_HW_INSTRUCTIONS,  "instructions" },
+  { PERF_COUNT_HW_CPU_CYCLES,    "cycles" },
+  { PERF_COUNT_HW_BRANCH_MISSES, "branch-misses" },
+  { PERF_COUNT_HW_CACHE_MISSES,  "cache-misses" },
+};
+
+static int  perf_leader = -1;
+static int  perf_slot[PERF_COUNTERS]; // position in the group read, or -1
+static int  perf_nopen = 0;
+static bool perf_tried = false;
+
+static int perf_open_event ( uint64_t config, int group )
+{
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.read_format = PERF_FORMAT_GROUP;
+  attr.disabled = (group == -1);
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+
+  return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+// One group, so that a single read returns all counters for the same
+// interval. Events the PMU does not have are left out.
+
+bool PerfOpen ( void )
+{
+  if(perf_tried) return perf_leader != -1;
+  perf_tried = true;
+
+  for(int i = 0; i < PERF_COUNTERS; i++)
+  {
+    perf_slot[i] = -1;
+
+    int fd = perf_open_event(perf_events[i].config, perf_leader);
+
+    if(fd == -1) continue;
+
+    if(perf_leader == -1) perf_leader = fd;
+    perf_slot[i] = perf_nopen++;
+  }
+
+  if(perf_leader == -1)
+  {
+    printf("WARNING: perf counters unavailable, reporting rdtsc cycles only\n");
+    return false;
+  }
+
+  for(int i = 0; i < PERF_COUNTERS; i++)
+  {
+    if(perf_slot[i] == -1)
+      printf("WARNING: perf counter %s unavailable\n", perf_events[i].name);
+  }
+
+  ioctl(perf_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+  return true;
+}
+
+void PerfRead ( uint64_t counts[PERF_COUNTERS] )
+{
+  uint64_t buf[1 + PERF_COUNTERS];
+
+  memset(counts, 0, PERF_COUNTERS * sizeof(uint64_t));
+
+  if(perf_leader == -1) return;
+
+  if(read(perf_leader, buf, sizeof(buf)) < (ssize_t)sizeof(uint64_t)) return;
+
+  for(int i = 0; i < PERF_COUNTERS; i++)
+  {
+    if(perf_slot[i] != -1 && (uint64_t)perf_slot[i] < buf[0])
+      counts[i] = buf[1 + perf_slot[i]];
+  }
+}
+
+#else
+
+bool PerfOpen ( void )
+{
+  printf("WARNING: perf counters unavailable, reporting rdtsc cycles only\n");
+  return false;
+}
+
+void PerfRead ( uint64_t counts[PERF_COUNTERS] )
+{
+  memset(counts, 0, PERF_COUNTERS * sizeof(uint64_t));
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+void PerfClear ( PerfCounts & c )
+{
+  memset(&c, 0, sizeof(c));
+}
+
+void PerfReport ( const PerfCounts & c, const char * unit )
+{
+  if(!g_perf || c.calls == 0) return;
+
+  const double calls = (double)c.calls;
+  const double insns = (double)c.count[PERF_INSTRUCTIONS];
+  const double cycles = (double)c.count[PERF_CYCLES];
+
+  printf("  perf - %5.2f IPC, %8.1f instructions/%s", cycles ? insns / cycles : 0.0,
+         insns / calls, unit);
+  if(c.bytes)
+    printf(", %6.2f instructions/byte", insns / (double)c.bytes);
+  printf(", %8.1f core cycles/%s, %6.3f branch-misses/%s, %6.3f cache-misses/%s\n",
+         cycles / calls, unit,
+         (double)c.count[PERF_BRANCH_MISSES] / calls, unit,
+         (double)c.count[PERF_CACHE_MISSES] / calls, unit);
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,81 @@
+//-----------------------------------------------------------------------------
+// Hardware performance counters for the speed tests, via Linux
+// perf_event_open. timer_start()/timer_end() count TSC ticks, which are not
+// core cycles once the clock scales. The counters add the core cycles,
+// instructions, branch misses and cache misses of this thread in user mode.
+// Where perf is unavailable (other OSes, perf_event_paranoid, no PMU in a
+// VM) only the rdtsc numbers are reported.
+
+#pragma once
+
+#include <stdint.h>
+
+enum PerfCounter
+{
+  PERF_INSTRUCTIONS,
+  PERF_CYCLES,
+  PERF_BRANCH_MISSES,
+  PERF_CACHE_MISSES,
+  PERF_COUNTERS
+};
+
+// Counts summed over a number of measured regions
+
+struct PerfCounts
+{
+  uint64_t count[PERF_COUNTERS];
+  uint64_t calls;   // hash calls (or map operations) in the regions
+  uint64_t bytes;   // key bytes hashed in the regions
+};
+
+extern bool g_perf; // --perf: read the counters around the measurements
+
+// Opens the counters on first use. False if none are available.
+
+bool PerfOpen ( void );
+
+// The current counter values, zero for counters that are not available
+
+void PerfRead ( uint64_t counts[PERF_COUNTERS] );
+
+void PerfClear ( PerfCounts & c );
+
+// Prints IPC and the counts per call and per byte
+
+void PerfReport ( const PerfCounts & c, const char * unit );
+
+// Adds the counts of a region to c, from construction to destruction.
+// Does nothing without --perf.
+
+struct PerfRegion
+{
+  PerfRegion ( PerfCounts & c, uint64_t calls, uint64_t bytes )
+  : m_counts(c), m_calls(calls), m_bytes(bytes)
+  {
+    if(g_perf) PerfRead(m_begin);
+  }
+
+  ~PerfRegion ()
+  {
+    if(!g_perf) return;
+
+    uint64_t end[PERF_COUNTERS];
+    PerfRead(end);
+
+    for(int i = 0; i < PERF_COUNTERS; i++) m_counts.count[i] += end[i] - m_begin[i];
+
+    m_counts.calls += m_calls;
+    m_counts.bytes += m_bytes;
+  }
+
+  PerfCounts & m_counts;
+  uint64_t m_calls;
+  uint64_t m_bytes;
+  uint64_t m_begin[PERF_COUNTERS];
+
+private:
+
+  PerfRegion & operator = ( const PerfRegion & );
+};
+
+//-----------------------------------------------------------------------------
@@ -1,6 +1,8 @@
 #include "Platform.h"
 
 #include <stdio.h>
+#include <string.h>
+#include <string>
 
 void testRDTSC ( void )
 {
@@ -8,34 +10,240 @@ void testRDTSC ( void )
   printf("%ld",(long)temp);
 }
 
+// the CPUs of the last successful SetAffinity
+static std::vector<int> s_affinity;
+
+bool SetAffinity ( int cpu )
+{
+  return SetAffinity(std::vector<int>(1, cpu));
+}
+
+bool ParseCPUList ( const char * spec, std::vector<int> & cpus )
+{
+  cpus.clear();
+
+  while(*spec)
+  {
+    char * end;
+    long first = strtol(spec, &end, 10);
+    long last = first;
+
+    if(end == spec || first < 0) return false;
+    if(*end == '-')
+    {
+      spec = end + 1;
+      last = strtol(spec, &end, 10);
+      if(end == spec || last < first) return false;
+    }
+    if(last >= 1024) return false;
+
+    for(long cpu = first; cpu <= last; cpu++) cpus.push_back((int)cpu);
+
+    if(*end == ',') end++;
+    else if(*end) return false;
+    spec = end;
+  }
+
+  return !cpus.empty();
+}
+
 #if defined(_MSC_VER)
 
 #include <windows.h>
 
-void SetAffinity ( int cpu )
+bool SetAffinity ( const std::vector<int> & cpus )
+{
+  DWORD_PTR mask = 0;
+
+  for(size_t i = 0; i < cpus.size(); i++)
+  {
+    if(cpus[i] >= (int)(8 * sizeof(mask))) return false;
+    mask |= (DWORD_PTR)1 << cpus[i];
+  }
+
+  if(!SetProcessAffinityMask(GetCurrentProcess(),mask)) return false;
+  // threads pinned by PinThread keep their own mask
+  SetThreadAffinityMask(GetCurrentThread(),mask);
+  s_affinity = cpus;
+  return true;
+}
+
+void AvailableCPUs ( std::vector<int> & cpus )
+{
+  DWORD_PTR process, system;
+
+  cpus = s_affinity;
+  if(!cpus.empty()) return;
+  if(GetProcessAffinityMask(GetCurrentProcess(), &process, &system))
+  {
+    for(int i = 0; i < (int)(8 * sizeof(process)); i++)
+      if(process & ((DWORD_PTR)1 << i)) cpus.push_back(i);
+  }
+  if(cpus.empty()) cpus.push_back(0);
+}
+
+bool PinThread ( int cpu )
 {
-  SetProcessAffinityMask(GetCurrentProcess(),cpu);
-  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+  return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+}
+
+bool RaisePriority ( void )
+{
+  return SetPriorityClass(GetCurrentProcess(), HIGH_PRIORITY_CLASS) &&
+         SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+}
+
+void CheckCPUFrequency ( const std::vector<int> & /*cpus*/ )
+{
+}
+
+size_t PhysicalMemory ( void )
+{
+  MEMORYSTATUSEX status;
+
+  status.dwLength = sizeof(status);
+  if(!GlobalMemoryStatusEx(&status)) return 0;
+  return (size_t)status.ullTotalPhys;
 }
 
 #else
 
 #include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
 
-void SetAffinity ( int /*cpu*/ )
-{
 #if !defined(__CYGWIN__) && !defined(__APPLE__) && !defined(__FreeBSD__)
+
+// the affinity of pid 0 is that of the calling thread, which new threads
+// and forked processes inherit
+bool SetAffinity ( const std::vector<int> & cpus )
+{
   cpu_set_t mask;
-    
+
   CPU_ZERO(&mask);
-    
-  CPU_SET(2,&mask);
-    
-  if( sched_setaffinity(0,sizeof(mask),&mask) == -1)
+
+  for(size_t i = 0; i < cpus.size(); i++)
+  {
+    if(cpus[i] >= CPU_SETSIZE) return false;
+    CPU_SET(cpus[i],&mask);
+  }
+
+  if(sched_setaffinity(0,sizeof(mask),&mask) != 0) return false;
+  s_affinity = cpus;
+  return true;
+}
+
+void AvailableCPUs ( std::vector<int> & cpus )
+{
+  cpu_set_t mask;
+
+  cpus = s_affinity;
+  if(!cpus.empty()) return;
+  if(sched_getaffinity(0,sizeof(mask),&mask) == 0)
   {
-    printf("WARNING: Could not set CPU affinity\n");
+    for(int i = 0; i < CPU_SETSIZE; i++)
+      if(CPU_ISSET(i,&mask)) cpus.push_back(i);
   }
+  if(cpus.empty()) cpus.push_back(0);
+}
+
+bool PinThread ( int cpu )
+{
+  cpu_set_t mask;
+
+  if(cpu < 0 || cpu >= CPU_SETSIZE) return false;
+  CPU_ZERO(&mask);
+  CPU_SET(cpu,&mask);
+  return sched_setaffinity(0,sizeof(mask),&mask) == 0;
+}
+
+#else
+
+#include <thread>
+
+bool SetAffinity ( const std::vector<int> & /*cpus*/ )
+{
+  return false;
+}
+
+void AvailableCPUs ( std::vector<int> & cpus )
+{
+  unsigned n = std::thread::hardware_concurrency();
+
+  cpus.clear();
+  for(unsigned i = 0; i < (n ? n : 1); i++) cpus.push_back((int)i);
+}
+
+bool PinThread ( int /*cpu*/ )
+{
+  return false;
+}
+
+#endif
+
+// nice -20, inherited by threads started later. Realtime policies are
+// avoided, the spinning speed test threads could starve the system.
+bool RaisePriority ( void )
+{
+  return setpriority(PRIO_PROCESS,0,-20) == 0;
+}
+
+size_t PhysicalMemory ( void )
+{
+#if defined(_SC_PHYS_PAGES)
+  long pages = sysconf(_SC_PHYS_PAGES);
+  long pagesize = sysconf(_SC_PAGESIZE);
+
+  if(pages > 0 && pagesize > 0) return (size_t)pages * (size_t)pagesize;
 #endif
+  return 0;
 }
 
+#if defined(__linux__)
+
+// first line of a sysfs file, empty if it does not exist
+static std::string ReadSysfs ( const char * path )
+{
+  char line[256] = "";
+  FILE * f = fopen(path,"r");
+
+  if(!f) return std::string();
+  if(!fgets(line,sizeof(line),f)) line[0] = 0;
+  fclose(f);
+
+  line[strcspn(line,"\r\n")] = 0;
+  return std::string(line);
+}
+
+void CheckCPUFrequency ( const std::vector<int> & cpus )
+{
+  for(size_t i = 0; i < cpus.size(); i++)
+  {
+    char path[128];
+    snprintf(path,sizeof(path),"/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor",cpus[i]);
+
+    std::string governor = ReadSysfs(path);
+    if(!governor.empty() && governor != "performance")
+    {
+      printf("WARNING: CPU %d frequency governor is %s, speed results will vary."
+             " Use the performance governor\n", cpus[i], governor.c_str());
+      break;
+    }
+  }
+
+  if(ReadSysfs("/sys/devices/system/cpu/intel_pstate/no_turbo") == "0" ||
+     ReadSysfs("/sys/devices/system/cpu/cpufreq/boost") == "1")
+  {
+    printf("WARNING: CPU turbo/boost is enabled, speed results will vary\n");
+  }
+}
+
+#else
+
+void CheckCPUFrequency ( const std::vector<int> & /*cpus*/ )
+{
+}
+
+#endif
+
 #endif
@@ -3,7 +3,37 @@
 
 #pragma once
 
-void SetAffinity ( int cpu );
+#include <vector>
+#include <stddef.h>
+
+// Restricts the process to the given CPUs (--cpu=N, --cpus=list). Threads
+// and worker processes started later inherit the set. False where that is
+// not supported or the CPUs are not available.
+
+bool SetAffinity ( const std::vector<int> & cpus );
+bool SetAffinity ( int cpu );
+
+// Parses a CPU list like "2" or "0,4-7"
+bool ParseCPUList ( const char * spec, std::vector<int> & cpus );
+
+// The CPUs this process may run on: those of the last successful
+// SetAffinity, else the affinity of the calling thread. PinThread pins the
+// calling thread to one of them, SetAffinity widens it again. PinThread
+// returns false where that is not supported.
+
+void AvailableCPUs ( std::vector<int> & cpus );
+bool PinThread ( int cpu );
+
+// Highest scheduling priority short of realtime (--priority). False if the
+// process lacks the privilege.
+bool RaisePriority ( void );
+
+// Warns when the clock of the given CPUs is not fixed: a frequency governor
+// other than performance, or turbo/boost enabled. Linux only.
+void CheckCPUFrequency ( const std::vector<int> & cpus );
+
+// Installed memory in bytes, 0 if unknown
+size_t PhysicalMemory ( void );
 
 #ifndef __x86_64__
  #if defined(__x86_64) || defined(_M_AMD64) || defined(_M_X64)
@@ -47,6 +77,14 @@ void SetAffinity ( int cpu );
 
 #define popcount8(x)  __popcnt(x)
 
+// leading zero bits of a nonzero 64-bit word
+inline int clz8 ( uint64_t x )
+{
+  unsigned long i;
+  _BitScanReverse64(&i, x);
+  return 63 - (int)i;
+}
+
 //-----------------------------------------------------------------------------
 // Other compilers
 
@@ -64,6 +102,9 @@ void SetAffinity ( int cpu );
 #define popcount8(x) __builtin_popcountl(x)
 #endif
 
+// leading zero bits of a nonzero 64-bit word
+#define clz8(x) __builtin_clzll(x)
+
 inline uint32_t rotl32 ( uint32_t x, int8_t r )
 {
   return (x << r) | (x >> (32 - r));
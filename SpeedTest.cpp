@@ -1,8 +1,10 @@
 #include "SpeedTest.h"
+#include "HashMapTest.h"
 #include "Random.h"
 #include "vmac.h"
 
 #include <stdio.h>   // for printf
+#include <stdlib.h>  // for strtol
 #include <memory.h>  // for memset
 #include <math.h>    // for sqrt
 #include <algorithm> // for sort, min
@@ -11,11 +13,19 @@
 #include <unordered_map>
 #include <parallel_hashmap/phmap.h>
 #include <functional>
+#include <chrono>
+#include <new>       // for bad_alloc
+#include <thread>
+#include <atomic>
 
-typedef std::unordered_map<std::string, int,
-  std::function<size_t (const std::string &key)>> std_hashmap;
-typedef phmap::flat_hash_map<std::string, int,
-  std::function<size_t (const std::string &key)>> fast_hashmap;
+#if defined(__SSE2__)
+#include <emmintrin.h> // for _mm_clflush
+#endif
+
+typedef std::unordered_map<HashMapKey, int,
+  std::function<size_t (const HashMapKey &key)>, HashMapKeyEq> std_hashmap;
+typedef phmap::flat_hash_map<HashMapKey, int,
+  std::function<size_t (const HashMapKey &key)>, HashMapKeyEq> fast_hashmap;
 
 //-----------------------------------------------------------------------------
 // We view our timing values as a series of random variables V that has been
@@ -162,11 +172,14 @@ void FilterOutliers2 ( std::vector<double> & v )
 // as possible, but that's hard to do portably. We'll try and get as close as
 // possible by marking the function as NEVER_INLINE (to keep the optimizer from
 // moving it) and marking the timing variables as "volatile register".
+// With --perf the counters are read outside of the rdtsc bracket.
 
-NEVER_INLINE int64_t timehash ( pfHash hash, const void * key, int len, int seed )
+NEVER_INLINE int64_t timehash ( pfHash hash, const void * key, int len, int seed,
+                                PerfCounts & perf )
 {
   volatile int64_t begin, end;
   uint32_t temp[16];
+  PerfRegion region(perf, 1, len);
 
   begin = timer_start();
   
@@ -181,7 +194,8 @@ NEVER_INLINE int64_t timehash ( pfHash hash, const void * key, int len, int seed
 // Specialized procedure for small lengths. Serialize invocations of the hash
 // function, make sure they would not be computed in parallel on an out-of-order CPU.
 
-NEVER_INLINE int64_t timehash_small ( pfHash hash, const void * key, int len, int seed )
+NEVER_INLINE int64_t timehash_small ( pfHash hash, const void * key, int len, int seed,
+                                      PerfCounts & perf )
 {
   const int NUM_TRIALS = 200;
   volatile unsigned long long int begin, end;
@@ -189,6 +203,9 @@ NEVER_INLINE int64_t timehash_small ( pfHash hash, const void * key, int len, in
   uint32_t *buf = new uint32_t[(len + 3) / 4];
   memcpy(buf,key,len);
 
+  {
+  PerfRegion region(perf, NUM_TRIALS, (uint64_t)len * NUM_TRIALS);
+
   begin = timer_start();
 
   for(int i = 0; i < NUM_TRIALS; i++) {
@@ -205,14 +222,53 @@ NEVER_INLINE int64_t timehash_small ( pfHash hash, const void * key, int len, in
   }
 
   end = timer_end();
+  }
+
   delete[] buf;
 
   return (int64_t)((end - begin) / (double)NUM_TRIALS);
 }
 
+//-----------------------------------------------------------------------------
+// Throughput of independent keys. There is no dependency between the calls,
+// so an out-of-order CPU overlaps successive hashes, as it does when a
+// service hashes a stream of unrelated keys. With a batch hash the keys go
+// to it 16 at a time.
+
+NEVER_INLINE int64_t timehash_throughput ( pfHash hash, pfHashBatch batch,
+                                           const void * const * keys, const int * lens,
+                                           int keycount, int hashsize, uint32_t seed,
+                                           uint8_t * outs )
+{
+  const int batchsize = 16;
+  volatile int64_t begin, end;
+
+  begin = timer_start();
+
+  if(batch)
+  {
+    for(int i = 0; i < keycount; i += batchsize)
+    {
+      batch(&keys[i], &lens[i], seed, &outs[i * hashsize], std::min(batchsize, keycount - i));
+    }
+  }
+  else
+  {
+    for(int i = 0; i < keycount; i++)
+    {
+      hash(keys[i], lens[i], seed, &outs[i * hashsize]);
+    }
+  }
+
+  end = timer_end();
+
+  return end - begin;
+}
+
 //-----------------------------------------------------------------------------
 
-double SpeedTest ( pfHash hash, uint32_t seed, const int trials, const int blocksize, const int align )
+double SpeedTest ( pfHash hash, uint32_t seed, const int trials, const int blocksize, const int align,
+                   PerfCounts & perf )
 {
   Rand r(seed);
   uint8_t * buf = new uint8_t[blocksize + 512];
@@ -238,11 +294,11 @@ double SpeedTest ( pfHash hash, uint32_t seed, const int trials, const int block
 
     if(blocksize < 100)
     {
-      t = (double)timehash_small(hash,block,blocksize,itrial);
+      t = (double)timehash_small(hash,block,blocksize,itrial,perf);
     }
     else
     {
-      t = (double)timehash(hash,block,blocksize,itrial);
+      t = (double)timehash(hash,block,blocksize,itrial,perf);
     }
 
     if(t > 0) times.push_back(t);
@@ -269,12 +325,15 @@ void BulkSpeedTest ( pfHash hash, uint32_t seed )
 
   printf("Bulk speed test - %d-byte keys\n",blocksize);
   double sumbpc = 0.0;
+  PerfCounts perf;
 
-  volatile double warmup_cycles = SpeedTest(hash,seed,trials,blocksize,0);
+  PerfClear(perf);
+  volatile double warmup_cycles = SpeedTest(hash,seed,trials,blocksize,0,perf);
+  PerfClear(perf);
 
   for(int align = 7; align >= 0; align--)
   {
-    double cycles = SpeedTest(hash,seed,trials,blocksize,align);
+    double cycles = SpeedTest(hash,seed,trials,blocksize,align,perf);
 
     double bestbpc = double(blocksize)/cycles;
 
@@ -284,47 +343,445 @@ void BulkSpeedTest ( pfHash hash, uint32_t seed )
   }
   sumbpc = sumbpc / 8.0;
   printf("Average      - %6.3f bytes/cycle - %7.2f MiB/sec @ 3 ghz\n",sumbpc,(sumbpc * 3000000000.0 / 1048576.0));
+  PerfReport(perf, "hash");
   fflush(NULL);
 }
 
 //-----------------------------------------------------------------------------
+// Bulk hashing over working sets from L1 sized to far beyond the last level
+// cache, hashed in blocks of various sizes. Warm runs follow a pass that
+// brings the set into cache, cold runs flush it from all levels before every
+// pass. The rdtsc cycles give bytes/cycle at the TSC rate, the wall clock
+// gives real GB/s.
+
+static void FlushCache ( const uint8_t * buf, size_t len )
+{
+#if defined(__SSE2__)
+  for(size_t i = 0; i < len; i += 64) _mm_clflush(buf + i);
+  _mm_mfence();
+#else
+  // evict by reading a buffer larger than the last level cache
+  static std::vector<uint8_t> evict(256 << 20, 1);
+  volatile uint8_t sink = 0;
+  for(size_t i = 0; i < evict.size(); i += 64) sink += evict[i];
+  (void)buf; (void)len;
+#endif
+}
 
-double TinySpeedTest ( pfHash hash, int hashsize, int keysize, uint32_t seed, bool verbose )
+NEVER_INLINE void timehash_sweep ( pfHash hash, const uint8_t * set, size_t setsize,
+                                   size_t blocksize, uint32_t seed, int passes, bool cold,
+                                   double & cycles, double & seconds )
+{
+  uint32_t temp[16];
+
+  cycles = 0;
+  seconds = 0;
+
+  // warm passes are timed as one interval, cold ones each without the flush.
+  // The clock is read inside the rdtsc bracket, as the serializing cpuid of
+  // timer_start() is slow under virtualization.
+  const int intervals = cold ? passes : 1;
+  const int inner = cold ? 1 : passes;
+
+  for(int interval = 0; interval < intervals; interval++)
+  {
+    if(cold) FlushCache(set, setsize);
+
+    volatile uint64_t begin = timer_start();
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+    for(int pass = 0; pass < inner; pass++)
+    {
+      for(size_t offset = 0; offset + blocksize <= setsize; offset += blocksize)
+      {
+        hash(set + offset, (int)blocksize, seed, temp);
+      }
+    }
+
+    std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+    volatile uint64_t end = timer_end();
+
+    cycles += (double)(end - begin);
+    seconds += std::chrono::duration<double>(t1 - t0).count();
+  }
+}
+
+void BulkSweepTest ( pfHash hash, uint32_t seed )
+{
+  const size_t target = 64 << 20; // bytes hashed per measurement
+  const size_t blocksizes[] = { 64, 1024, 16 << 10, 256 << 10, 4 << 20 };
+  size_t maxset = size_t(1) << 30;
+  uint8_t * set = NULL;
+
+  // With overcommit the allocation succeeds anyway and the OOM killer
+  // strikes when the pages are filled, so stay within a quarter of the
+  // installed memory. bad_alloc is left for systems without overcommit.
+  const size_t physical = PhysicalMemory();
+  while(physical && maxset > physical / 4 && maxset >= (4 << 20))
+    maxset /= 4;
+
+  while(!set && maxset >= (4 << 20))
+  {
+    try { set = new uint8_t[maxset]; }
+    catch (std::bad_alloc &) { maxset /= 4; }
+  }
+  if(!set)
+  {
+    printf("Bulk sweep - out of memory, SKIP\n");
+    return;
+  }
+
+  Rand r(seed);
+  r.rand_p(set, (int)std::min(maxset, (size_t)1 << 30));
+
+  printf("Bulk sweep - bytes/cycle at the TSC rate, GB/s by wall clock\n");
+  printf("Working set     Block  -   warm B/c  warm GB/s  -   cold B/c  cold GB/s\n");
+
+  for(size_t setsize = 4 << 10; setsize <= maxset; setsize *= 4)
+  {
+    for(size_t i = 0; i < sizeof(blocksizes) / sizeof(blocksizes[0]); i++)
+    {
+      const size_t blocksize = blocksizes[i];
+
+      if(blocksize > setsize) break;
+
+      const int passes = (int)std::max((size_t)1, target / setsize);
+      double warmcycles, warmseconds, coldcycles, coldseconds, dummy;
+
+      timehash_sweep(hash, set, setsize, blocksize, seed, 1, false, dummy, dummy);
+      timehash_sweep(hash, set, setsize, blocksize, seed, passes, false, warmcycles, warmseconds);
+      timehash_sweep(hash, set, setsize, blocksize, seed, passes, true, coldcycles, coldseconds);
+
+      const double bytes = (double)(setsize / blocksize * blocksize) * passes;
+
+      printf("%7zu KiB %9zu  -  %9.3f %10.3f  -  %9.3f %10.3f\n",
+             setsize >> 10, blocksize,
+             bytes / warmcycles, bytes / warmseconds / 1e9,
+             bytes / coldcycles, bytes / coldseconds / 1e9);
+      fflush(NULL);
+    }
+  }
+
+  delete [] set;
+}
+
+//-----------------------------------------------------------------------------
+// Aggregate throughput with 1, 2, 4, ... up to all available threads hashing
+// at once, each pinned to its own CPU and hashing its own keys. This exposes
+// frequency throttling of wide vector units, contention on tables shared
+// between threads and memory bandwidth limits, which a single thread does
+// not see. Efficiency is the aggregate relative to n times the single thread
+// rate.
+
+// hashes and bytes per second done by nthreads threads in duration seconds,
+// each hashing count keys with the sizes cycling through keysizes
+static void ScalingRun ( pfHash hash, uint32_t seed, const std::vector<int> & cpus,
+                         unsigned nthreads, const std::vector<int> & keysizes, int count,
+                         double duration, double & hashesps, double & bytesps,
+                         bool & pinned )
+{
+  struct Counter
+  {
+    uint64_t hashes;
+    uint64_t bytes;
+    uint64_t pad[6]; // own cache line
+  };
+
+  std::vector<Counter> counters(nthreads);
+  std::atomic<unsigned> ready(0);
+  std::atomic<bool> go(false);
+  std::atomic<bool> stop(false);
+  std::atomic<bool> unpinned(false);
+
+  auto worker = [&] ( unsigned t )
+  {
+    if(!PinThread(cpus[t % cpus.size()])) unpinned = true;
+
+    // allocated after pinning, so the keys are local to the thread's CPU
+    std::vector<int> lens(count);
+    size_t total = 0;
+
+    for(int i = 0; i < count; i++)
+    {
+      lens[i] = keysizes[i % keysizes.size()];
+      total += lens[i];
+    }
+
+    std::vector<uint8_t> keys(total);
+    Rand r(seed + t);
+    r.rand_p(&keys[0], (int)total);
+
+    uint32_t temp[16];
+    uint64_t hashes = 0;
+    uint64_t bytes = 0;
+
+    ready++;
+    while(!go.load()) std::this_thread::yield();
+
+    while(!stop.load(std::memory_order_relaxed))
+    {
+      const uint8_t * key = &keys[0];
+
+      for(int i = 0; i < count; i++)
+      {
+        hash(key, lens[i], seed, temp);
+        key += lens[i];
+      }
+
+      hashes += count;
+      bytes += total;
+    }
+
+    counters[t].hashes = hashes;
+    counters[t].bytes = bytes;
+  };
+
+  std::vector<std::thread> threads;
+
+  for(unsigned t = 0; t < nthreads; t++)
+  {
+    threads.push_back(std::thread(worker, t));
+  }
+
+  while(ready.load() < nthreads) std::this_thread::yield();
+
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  go = true;
+  std::this_thread::sleep_for(std::chrono::duration<double>(duration));
+  stop = true;
+
+  for(unsigned t = 0; t < nthreads; t++)
+  {
+    threads[t].join();
+  }
+
+  std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(t1 - t0).count();
+
+  hashesps = 0;
+  bytesps = 0;
+
+  for(unsigned t = 0; t < nthreads; t++)
+  {
+    hashesps += (double)counters[t].hashes;
+    bytesps += (double)counters[t].bytes;
+  }
+
+  hashesps /= seconds;
+  bytesps /= seconds;
+  if(unpinned) pinned = false;
+}
+
+void ScalingSpeedTest ( pfHash hash, uint32_t seed, unsigned maxthreads )
+{
+  const double duration = 0.5;
+  std::vector<int> cpus;
+
+  AvailableCPUs(cpus);
+
+  unsigned ncpu = (unsigned)cpus.size();
+  if(maxthreads && maxthreads < ncpu) ncpu = maxthreads;
+
+  std::vector<unsigned> counts;
+  for(unsigned n = 1; n < ncpu; n *= 2) counts.push_back(n);
+  counts.push_back(ncpu);
+
+  std::vector<int> bulksizes(1, 256 * 1024);
+  std::vector<int> tinysizes;
+  for(int i = 1; i < 32; i++) tinysizes.push_back(i);
+
+  const struct
+  {
+    const char * name;
+    const std::vector<int> & keysizes;
+    int count;
+    bool bulk;
+  }
+  workloads[] =
+  {
+    { "256 KiB keys",    bulksizes, 1,    true },
+    { "1-31 byte keys",  tinysizes, 1024, false },
+  };
+
+  // hashes which set up shared tables on first use do so here
+  uint32_t temp[16];
+  hash(&tinysizes[0], 4, seed, temp);
+
+  bool pinned = true;
+
+  for(size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++)
+  {
+    const char * unit = workloads[w].bulk ? "GB/s" : "Mhash/s";
+    double base = 0;
+
+    printf("Scaling - %s, %u CPUs\n", workloads[w].name, ncpu);
+    printf("Threads  -    aggregate       per thread  efficiency\n");
+
+    for(size_t i = 0; i < counts.size(); i++)
+    {
+      double hashesps, bytesps;
+
+      ScalingRun(hash, seed, cpus, counts[i], workloads[w].keysizes, workloads[w].count,
+                 duration, hashesps, bytesps, pinned);
+
+      double rate = workloads[w].bulk ? bytesps / 1e9 : hashesps / 1e6;
+      if(i == 0) base = rate;
+
+      printf("%7u  -  %8.3f %-7s %8.3f %-7s  %6.1f%%\n", counts[i],
+             rate, unit, rate / counts[i], unit, 100.0 * rate / (counts[i] * base));
+      fflush(NULL);
+    }
+    printf("\n");
+  }
+
+  if(!pinned)
+    printf("WARNING: Could not pin the threads to CPUs\n");
+}
+
+//-----------------------------------------------------------------------------
+
+double TinySpeedTest ( pfHash hash, int hashsize, int keysize, uint32_t seed, bool verbose,
+                       PerfCounts * perf )
 {
   const int trials = 99999;
+  PerfCounts counts;
 
   if(verbose) printf("Small key speed test - %4d-byte keys - ",keysize);
+
+  PerfClear(counts);
+  double cycles = SpeedTest(hash,seed,trials,keysize,0,perf ? *perf : counts);
   
-  double cycles = SpeedTest(hash,seed,trials,keysize,0);
-  
-  printf("%8.2f cycles/hash\n",cycles);
+  printf("%8.2f cycles/hash",cycles);
   return cycles;
 }
 
+//-----------------------------------------------------------------------------
+// Cycles per hash for a stream of independent keys. The key lengths are
+// drawn from keysizes, in which each length appears as often as it should
+// be picked.
+
+double ThroughputSpeedTest ( pfHash hash, pfHashBatch batch, int hashsize,
+                             const std::vector<int> & keysizes, uint32_t seed )
+{
+  const int trials = 999;
+  const int keycount = 1024;
+
+  Rand r(seed);
+
+  std::vector<int> lens(keycount);
+  std::vector<const void *> keys(keycount);
+  size_t total = 0;
+
+  for(int i = 0; i < keycount; i++)
+  {
+    lens[i] = keysizes[r.rand_u32() % keysizes.size()];
+    total += lens[i];
+  }
+
+  // the keys back to back, like in a receive buffer. Some hashes write
+  // more than hashsize bytes, hence the slack after the last slot
+  std::vector<uint8_t> buf(total + 1);
+  std::vector<uint8_t> outs(keycount * hashsize + 256);
+
+  r.rand_p(&buf[0], (int)buf.size());
+
+  for(int i = 0, offset = 0; i < keycount; offset += lens[i], i++)
+  {
+    keys[i] = &buf[offset];
+  }
+
+  //----------
+
+  std::vector<double> times;
+  times.reserve(trials);
+
+  for(int itrial = 0; itrial < trials; itrial++)
+  {
+    double t = (double)timehash_throughput(hash, batch, &keys[0], &lens[0], keycount,
+                                           hashsize, itrial, &outs[0]);
+
+    if(t > 0) times.push_back(t / keycount);
+  }
+
+  std::sort(times.begin(),times.end());
+
+  FilterOutliers(times);
+
+  return CalcMean(times);
+}
+
+// Key size distributions like "1-16", "8,16,32" or "8:3,100-199:1": lengths
+// and ranges of lengths, each with an optional relative weight.
+
+bool ParseKeySizes ( const char * spec, std::vector<int> & keysizes )
+{
+  keysizes.clear();
+
+  while(*spec)
+  {
+    char * end;
+    long lo = strtol(spec, &end, 10);
+    long hi = lo;
+    long weight = 1;
+
+    if(end == spec) return false;
+    spec = end;
+
+    if(*spec == '-')
+    {
+      hi = strtol(spec + 1, &end, 10);
+      if(end == spec + 1) return false;
+      spec = end;
+    }
+
+    if(*spec == ':')
+    {
+      weight = strtol(spec + 1, &end, 10);
+      if(end == spec + 1) return false;
+      spec = end;
+    }
+
+    if(lo < 1 || hi < lo || hi > 65536 || weight < 1 || weight > 1000) return false;
+
+    for(long len = lo; len <= hi; len++)
+      keysizes.insert(keysizes.end(), weight, (int)len);
+
+    if(*spec == ',') spec++;
+    else if(*spec) return false;
+  }
+
+  return !keysizes.empty();
+}
+
 double HashMapSpeedTest ( pfHash pfhash, const int hashbits,
-                          std::vector<std::string> words,
-                          const int trials, bool verbose )
+                          const HashMapWords & words,
+                          const int trials, bool verbose, PerfCounts * perf )
 {
   //using phmap::flat_node_hash_map;
   Rand r(82762);
   const uint32_t seed = r.rand_u32();
-  std_hashmap hashmap(words.size(), [=](const std::string &key)
+  std_hashmap hashmap(words.size(), [=](const HashMapKey &key)
                   {
                     // 256 needed for hasshe2, but only size_t used
                     static char out[256] = { 0 };
-                    pfhash(key.c_str(), key.length(), seed, &out);
+                    pfhash(key.ptr, (int)key.len, seed, &out);
                     return *(size_t*)out;
-                  });
-  fast_hashmap phashmap(words.size(), [=](const std::string &key)
+                  }, HashMapKeyEq());
+  fast_hashmap phashmap(words.size(), [=](const HashMapKey &key)
                   {
                     static char out[256] = { 0 }; // 256 for hasshe2, but stripped to 64/32
-                    pfhash(key.c_str(), key.length(), seed, &out);
+                    pfhash(key.ptr, (int)key.len, seed, &out);
                     return *(size_t*)out;
-                  });
+                  }, HashMapKeyEq());
   
-  std::vector<std::string>::iterator it;
+  std::vector<HashMapKey>::const_iterator it;
   std::vector<double> times;
   double t1;
+  PerfCounts stdperf, fastperf;
+  const uint64_t wordbytes = words.bytes;
+
+  PerfClear(stdperf);
+  PerfClear(fastperf);
 
   printf("std::unordered_map\n");
   printf("Init std HashMapTest:     ");
@@ -334,11 +791,10 @@ double HashMapSpeedTest ( pfHash pfhash, const int hashbits,
     volatile int64_t begin, end;
     int i = 0;
     begin = timer_start();
-    for (it = words.begin(); it != words.end(); it++, i++) {
-      std::string line = *it;
-      hashmap[line] = 1;
+    for (it = words.keys.begin(); it != words.keys.end(); it++, i++) {
+      hashmap[*it] = 1;
       if (i % 100 == 0)
-        hashmap.erase(line);
+        hashmap.erase(*it);
     }
     end = timer_end();
     t1 = (double)(end - begin) / (double)words.size();
@@ -358,11 +814,11 @@ double HashMapSpeedTest ( pfHash pfhash, const int hashbits,
       volatile int64_t begin, end;
       int i = 0, found = 0;
       double t;
+      PerfRegion region(stdperf, words.size(), wordbytes);
       begin = timer_start();
-      for ( it = words.begin(); it != words.end(); it++, i++ )
+      for ( it = words.keys.begin(); it != words.keys.end(); it++, i++ )
         {
-          std::string line = *it;
-          if (hashmap[line])
+          if (hashmap.find(*it) != hashmap.end())
             found++;
         }
       end = timer_end();
@@ -377,6 +833,7 @@ double HashMapSpeedTest ( pfHash pfhash, const int hashbits,
   double stdv = CalcStdv(times);
   printf("%0.3f cycles/op", mean);
   printf(" (%0.1f stdv)\n", stdv);
+  PerfReport(stdperf, "op");
 
   times.clear();
 
@@ -395,11 +852,10 @@ double HashMapSpeedTest ( pfHash pfhash, const int hashbits,
     volatile int64_t begin, end;
     int i = 0;
     begin = timer_start();
-    for (it = words.begin(); it != words.end(); it++, i++) {
-      std::string line = *it;
-      phashmap[line] = 1;
+    for (it = words.keys.begin(); it != words.keys.end(); it++, i++) {
+      phashmap[*it] = 1;
       if (i % 100 == 0)
-        phashmap.erase(line);
+        phashmap.erase(*it);
     }
     end = timer_end();
     t1 = (double)(end - begin) / (double)words.size();
@@ -418,11 +874,11 @@ double HashMapSpeedTest ( pfHash pfhash, const int hashbits,
       volatile int64_t begin, end;
       int i = 0, found = 0;
       double t;
+      PerfRegion region(fastperf, words.size(), wordbytes);
       begin = timer_start();
-      for ( it = words.begin(); it != words.end(); it++, i++ )
+      for ( it = words.keys.begin(); it != words.keys.end(); it++, i++ )
         {
-          std::string line = *it;
-          if (phashmap[line])
+          if (phashmap.find(*it) != phashmap.end())
             found++;
         }
       end = timer_end();
@@ -440,6 +896,9 @@ double HashMapSpeedTest ( pfHash pfhash, const int hashbits,
   printf(" (%0.1f stdv) ", stdv1);
   fflush(NULL);
 
+  // the caller reports these after its verdict on the line above
+  if(perf) *perf = fastperf;
+
   return mean;
 }
 
@@ -1,9 +1,18 @@
 #pragma once
 
 #include "Types.h"
+#include "PerfCounters.h"
+
+double CalcMean ( std::vector<double> & v );
+double CalcStdv ( std::vector<double> & v );
+void FilterOutliers ( std::vector<double> & v );
 
 void BulkSpeedTest ( pfHash hash, uint32_t seed );
-double TinySpeedTest ( pfHash hash, int hashsize, int keysize, uint32_t seed, bool verbose );
-double HashMapSpeedTest ( pfHash pfhash, int hashbits, std::vector<std::string> words,
-                          const int trials, bool verbose );
+void BulkSweepTest ( pfHash hash, uint32_t seed );
+void ScalingSpeedTest ( pfHash hash, uint32_t seed, unsigned maxthreads );
+double TinySpeedTest ( pfHash hash, int hashsize, int keysize, uint32_t seed, bool verbose,
+                       PerfCounts * perf = NULL );
+double ThroughputSpeedTest ( pfHash hash, pfHashBatch batch, int hashsize,
+                             const std::vector<int> & keysizes, uint32_t seed );
+bool ParseKeySizes ( const char * spec, std::vector<int> & keysizes );
 //-----------------------------------------------------------------------------
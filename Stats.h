@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Types.h"
+#include "Parallel.h"
 
 #include <math.h>
 #include <vector>
@@ -31,6 +32,129 @@ inline uint32_t f3mix ( uint32_t k )
   return k;
 }
 
+//-----------------------------------------------------------------------------
+// Radix sort for hash lists, in the same order as std::sort. Blob compares
+// as a little-endian integer, so both it and the integer types are sorted
+// byte by byte from the most significant one down.
+//
+// MSD (American flag) sort: count the values of the current byte, permute
+// the range in place into 256 buckets, then sort each bucket on the next
+// byte. Small buckets go to std::sort. Needs no extra memory, and hash
+// values are uniform enough that two or three levels split a list into
+// tiny buckets. With --threads the top level buckets are sorted in
+// parallel.
+
+inline uint8_t RadixByte ( uint32_t x, int i ) { return (uint8_t)(x >> (8*i)); }
+inline uint8_t RadixByte ( uint64_t x, int i ) { return (uint8_t)(x >> (8*i)); }
+
+template < int _bits >
+inline uint8_t RadixByte ( const Blob<_bits> & x, int i ) { return x[i]; }
+
+// Permute [begin, begin+n) into buckets by byte i, returning the bucket sizes
+
+template< typename hashtype >
+void RadixPartition ( hashtype * begin, size_t n, int i, size_t count[256] )
+{
+  size_t next[256], end[256];
+
+  memset(count, 0, 256 * sizeof(size_t));
+
+  for(size_t j = 0; j < n; j++)
+  {
+    count[RadixByte(begin[j],i)]++;
+  }
+
+  size_t offset = 0;
+  for(int b = 0; b < 256; b++)
+  {
+    next[b] = offset;
+    offset += count[b];
+    end[b] = offset;
+  }
+
+  for(int b = 0; b < 256; b++)
+  {
+    while(next[b] < end[b])
+    {
+      hashtype & v = begin[next[b]];
+      uint8_t vb = RadixByte(v,i);
+
+      if(vb == b)
+      {
+        next[b]++;
+      }
+      else
+      {
+        std::swap(v, begin[next[vb]++]);
+      }
+    }
+  }
+}
+
+template< typename hashtype >
+void RadixSort ( hashtype * begin, size_t n, int i )
+{
+  for(;;)
+  {
+    if(n < 64 || i < 0)
+    {
+      if(i >= 0) std::sort(begin, begin + n);
+      return;
+    }
+
+    size_t count[256];
+
+    RadixPartition(begin, n, i, count);
+
+    i--;
+
+    // a byte with the same value everywhere does not split the range
+    if(count[RadixByte(begin[0],i+1)] == n)
+      continue;
+
+    size_t offset = 0;
+    for(int b = 0; b < 256; b++)
+    {
+      if(count[b] > 1) RadixSort(begin + offset, count[b], i);
+      offset += count[b];
+    }
+    return;
+  }
+}
+
+template< typename hashtype >
+void RadixSort ( std::vector<hashtype> & hashes )
+{
+  const size_t n = hashes.size();
+  int i = sizeof(hashtype) - 1;
+
+  if(g_NCPU <= 1 || n < 65536)
+  {
+    if(n) RadixSort(&hashes[0], n, i);
+    return;
+  }
+
+  size_t count[256];
+
+  // skip the leading bytes which are the same everywhere
+  for(; i >= 0; i--)
+  {
+    RadixPartition(&hashes[0], n, i, count);
+    if(count[RadixByte(hashes[0],i)] != n) break;
+  }
+
+  if(i-- <= 0) return;
+
+  size_t offset[257];
+  offset[0] = 0;
+  for(int b = 0; b < 256; b++) offset[b+1] = offset[b] + count[b];
+
+  ParallelFor(256, g_NCPU, [&] ( size_t b, unsigned )
+  {
+    if(count[b] > 1) RadixSort(&hashes[offset[b]], count[b], i);
+  });
+}
+
 //-----------------------------------------------------------------------------
 // Sort the hash list, count the total number of collisions and return
 // the first N collisions for further processing
@@ -42,7 +166,7 @@ int FindCollisions ( std::vector<hashtype> & hashes,
 {
   int collcount = 0;
 
-  std::sort(hashes.begin(),hashes.end());
+  RadixSort(hashes);
 
   for(size_t hnb = 1; hnb < hashes.size(); hnb++)
   {
@@ -74,70 +198,171 @@ static double EstimateNbCollisions(int nbH, int nbBits)
   //return ExpectedCollisions((double)nbH, (double)nbBits);
 }
 
+// Count the collisions in the highest bits of a sorted hash list for all
+// widths in one pass. Two neighbours collide in their top b bits exactly if
+// they share a prefix of at least b bits, so a histogram of the common
+// prefix lengths gives all widths: collcounts[b] is the number of
+// collisions in the top b bits, for b = 0..hashbits. For the low bits, pass
+// the sorted bit-reversed list.
+
+inline int CommonPrefixBits ( uint32_t a, uint32_t b )
+{
+  uint32_t x = a ^ b;
+  return x ? clz8(x) - 32 : 32;
+}
+
+inline int CommonPrefixBits ( uint64_t a, uint64_t b )
+{
+  uint64_t x = a ^ b;
+  return x ? clz8(x) : 64;
+}
+
+template < int _bits >
+inline int CommonPrefixBits ( const Blob<_bits> & a, const Blob<_bits> & b )
+{
+  return a.commonprefix(b);
+}
+
 template< typename hashtype >
-bool CountLowbitsCollisions ( std::vector<hashtype> & revhashes, int nbLBits)
+void CountPrefixCollisions ( std::vector<hashtype> & hashes, std::vector<int> & collcounts )
 {
   const int origBits = sizeof(hashtype) * 8;
-  int shiftBy = origBits - nbLBits;
 
-  if (shiftBy <= 0) return true;
+  collcounts.assign(origBits + 1, 0);
 
-  size_t const nbH = revhashes.size();
-  double expected = EstimateNbCollisions(nbH, nbLBits);
-  printf("Testing collisions (low  %2i-bit) - Expected %12.1f, ", nbLBits, expected);
-  int collcount = 0;
+  for (size_t hnb = 1; hnb < hashes.size(); hnb++)
+  {
+    collcounts[CommonPrefixBits(hashes[hnb-1], hashes[hnb])]++;
+  }
 
-  for (size_t hnb = 1; hnb < nbH; hnb++)
+  for (int b = origBits - 1; b >= 0; b--)
   {
-#ifdef DEBUG
-    hashtype const h1x = revhashes[hnb-1];
-    hashtype const h2x = revhashes[hnb];
-#endif
-    hashtype const h1 = revhashes[hnb-1] >> shiftBy;
-    hashtype const h2 = revhashes[hnb]   >> shiftBy;
-    if(h1 == h2)
-      collcount++;
+    collcounts[b] += collcounts[b+1];
   }
+}
 
-  printf("actual %6i (%.2fx)", collcount, collcount / expected);
-  if (collcount/expected > 0.98 && collcount != (int)expected)
-    printf(" (%i)", collcount - (int)expected);
+// The same for the lowest bits. Rather than sorting a bit-reversed copy of
+// the whole list, only the low 64 bits are reversed (word-wise) and sorted.
+// The neighbours which agree in all of them are rare; their hashes are
+// looked up again to count the collisions in the wider low bits.
 
-  if(double(collcount) / double(expected) > 2.0)
+inline uint32_t bitreverse32 ( uint32_t x )
+{
+  x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+  x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+  x = ((x >> 4) & 0x0F0F0F0F) | ((x & 0x0F0F0F0F) << 4);
+  x = ((x >> 8) & 0x00FF00FF) | ((x & 0x00FF00FF) << 8);
+  return (x >> 16) | (x << 16);
+}
+
+inline uint64_t bitreverse64 ( uint64_t x )
+{
+  return (uint64_t(bitreverse32((uint32_t)x)) << 32) | bitreverse32((uint32_t)(x >> 32));
+}
+
+inline uint32_t LowbitsReversed ( uint32_t h ) { return bitreverse32(h); }
+inline uint64_t LowbitsReversed ( uint64_t h ) { return bitreverse64(h); }
+
+template < int _bits >
+inline uint64_t LowbitsReversed ( const Blob<_bits> & h )
+{
+  uint64_t x = 0;
+  for(int i = 0; i < 8 && i < (int)sizeof(h); i++)
   {
-    printf(" !!!!!\n");
-    return false;
+    x |= uint64_t(h[i]) << (8*i);
   }
+  return bitreverse64(x);
+}
 
-  printf("\n");
-  return true;
+// 0xf00f1001 => 0x8008f00f
+template <typename hashtype>
+hashtype bitreverse(hashtype n, size_t b = sizeof(hashtype) * 8)
+{
+    assert(b <= std::numeric_limits<hashtype>::digits);
+    hashtype rv = 0;
+    for (size_t i = 0; i < b; i += 8) {
+        rv <<= 8;
+        rv |= bitrev(n & 0xff); // ensure overloaded |= op for Blob not underflowing
+        n >>= 8;
+    }
+    return rv;
 }
 
 template< typename hashtype >
-bool CountHighbitsCollisions ( std::vector<hashtype> & hashes, int nbHBits)
+void CountSuffixCollisions ( std::vector<hashtype> & hashes, std::vector<int> & collcounts )
 {
-  int origBits = sizeof(hashtype) * 8;
-  int shiftBy = origBits - nbHBits;
+  typedef decltype(LowbitsReversed(hashes[0])) lowtype;
+
+  const int origBits = sizeof(hashtype) * 8;
+  const int lowBits = sizeof(lowtype) * 8;
 
-  if (shiftBy <= 0) return true;
+  collcounts.assign(origBits + 1, 0);
 
-  size_t const nbH = hashes.size();
-  double expected = EstimateNbCollisions(nbH, nbHBits);
-  printf("Testing collisions (high %2i-bit) - Expected %12.1f, ", nbHBits, expected);
-  int collcount = 0;
+  std::vector<lowtype> low(hashes.size());
 
-  for (size_t hnb = 1; hnb < nbH; hnb++)
+  for (size_t i = 0; i < hashes.size(); i++)
   {
-#ifdef DEBUG
-    hashtype const h1x = hashes[hnb-1];
-    hashtype const h2x = hashes[hnb];
-#endif
-    hashtype const h1 = hashes[hnb-1] >> shiftBy;
-    hashtype const h2 = hashes[hnb]   >> shiftBy;
-    if(h1 == h2)
-      collcount++;
+    low[i] = LowbitsReversed(hashes[i]);
   }
 
+  RadixSort(low);
+
+  // the low bits shared by neighbours which agree in all low bits
+  std::vector<lowtype> ties;
+
+  for (size_t hnb = 1; hnb < low.size(); hnb++)
+  {
+    int bits = CommonPrefixBits(low[hnb-1], low[hnb]);
+
+    if (bits < lowBits || origBits <= lowBits)
+      collcounts[bits]++;
+    else if (ties.empty() || ties.back() != low[hnb])
+      ties.push_back(low[hnb]);
+  }
+
+  std::vector<lowtype>().swap(low);
+
+  if (!ties.empty())
+  {
+    std::vector<hashtype> tied;
+
+    for (size_t i = 0; i < hashes.size(); i++)
+    {
+      if (std::binary_search(ties.begin(), ties.end(), LowbitsReversed(hashes[i])))
+        tied.push_back(bitreverse(hashes[i], origBits));
+    }
+
+    RadixSort(tied);
+
+    for (size_t hnb = 1; hnb < tied.size(); hnb++)
+    {
+      int bits = CommonPrefixBits(tied[hnb-1], tied[hnb]);
+
+      // neighbours from different groups were counted above
+      if (bits >= lowBits)
+        collcounts[bits]++;
+    }
+  }
+
+  for (int b = origBits - 1; b >= 0; b--)
+  {
+    collcounts[b] += collcounts[b+1];
+  }
+}
+
+// side is "high" or "low "
+
+static bool CountPrefixBitsCollisions ( const char * side, std::vector<int> & collcounts,
+                                        size_t nbH, int nbBits )
+{
+  const int origBits = (int)collcounts.size() - 1;
+
+  if (nbBits >= origBits) return true;
+
+  double expected = EstimateNbCollisions(nbH, nbBits);
+  printf("Testing collisions (%s %2i-bit) - Expected %12.1f, ", side, nbBits, expected);
+  int collcount = collcounts[nbBits];
+
   printf("actual %6i (%.2fx)", collcount, collcount / expected);
   if (collcount/expected > 0.98 && collcount != (int)expected)
     printf(" (%i)", collcount - (int)expected);
@@ -175,89 +400,23 @@ static int FindMaxBits_TargetCollisionNb(int nbHashes, int minCollisions)
     return nb;
 }
 
-template< typename hashtype >
-int CountNbCollisions ( std::vector<hashtype> & hashes, int nbHBits)
-{
-  const int origBits = sizeof(hashtype) * 8;
-  const int shiftBy = origBits - nbHBits;
-
-  assert(shiftBy > 0);
-
-  size_t const nbH = hashes.size();
-  int collcount = 0;
-
-  for (size_t hnb = 1; hnb < nbH; hnb++)
-  {
-    hashtype const h1 = hashes[hnb-1] >> shiftBy;
-    hashtype const h2 = hashes[hnb]   >> shiftBy;
-    if(h1 == h2)
-    {
-      collcount++;
-    }
-  }
-
-  return collcount;
-}
-
-template< typename hashtype >
-bool TestLowbitsCollisions ( std::vector<hashtype> & revhashes)
-{
-  int origBits = sizeof(hashtype) * 8;
-
-  size_t const nbH = revhashes.size();
-  int const minBits = FindMinBits_TargetCollisionShare(nbH, 0.01);
-  int const maxBits = FindMaxBits_TargetCollisionNb(nbH, 20);
-  if (maxBits <= 0 || maxBits >= origBits) return true;
-
-  printf("Testing collisions (low  %2i-%2i bits) - ", minBits, maxBits);
-  double maxCollDev = 0.0;
-  int maxCollDevBits = 0;
-  int maxCollDevNb = 0;
-  double maxCollDevExp = 1.0;
-
-  for (int b = minBits; b <= maxBits; b++) {
-      int    const nbColls = CountNbCollisions(revhashes, b);
-      double const expected = EstimateNbCollisions(nbH, b);
-      assert(expected > 0.0);
-      double const dev = (double)nbColls / expected;
-      if (dev > maxCollDev) {
-          maxCollDev = dev;
-          maxCollDevBits = b;
-          maxCollDevNb = nbColls;
-          maxCollDevExp = expected;
-      }
-  }
-
-  printf("Worst is %2i bits: %2i/%2i (%.2fx)",
-        maxCollDevBits, maxCollDevNb, (int)maxCollDevExp, maxCollDev);
-
-  if (maxCollDev > 2.0) {
-    printf(" !!!!!\n");
-    return false;
-  }
-
-  printf("\n");
-  return true;
-}
-
-template< typename hashtype >
-bool TestHighbitsCollisions ( std::vector<hashtype> & hashes)
+static bool TestPrefixBitsCollisions ( const char * side, std::vector<int> & collcounts,
+                                       size_t nbH )
 {
-  int origBits = sizeof(hashtype) * 8;
+  const int origBits = (int)collcounts.size() - 1;
 
-  size_t const nbH = hashes.size();
   int const minBits = FindMinBits_TargetCollisionShare(nbH, 0.01);
   int const maxBits = FindMaxBits_TargetCollisionNb(nbH, 20);
   if (maxBits >= origBits) return true;
 
-  printf("Testing collisions (high %2i-%2i bits) - ", minBits, maxBits);
+  printf("Testing collisions (%s %2i-%2i bits) - ", side, minBits, maxBits);
   double maxCollDev = 0.0;
   int maxCollDevBits = 0;
   int maxCollDevNb = 0;
   double maxCollDevExp = 1.0;
 
   for (int b = minBits; b <= maxBits; b++) {
-      int    const nbColls = CountNbCollisions(hashes, b);
+      int    const nbColls = collcounts[b];
       double const expected = EstimateNbCollisions(nbH, b);
       assert(expected > 0.0);
       double const dev = (double)nbColls / expected;
@@ -283,8 +442,8 @@ bool TestHighbitsCollisions ( std::vector<hashtype> & hashes)
 
 //-----------------------------------------------------------------------------
 
-template < class keytype, typename hashtype >
-int PrintCollisions ( hashfunc<hashtype> hash, std::vector<keytype> & keys )
+template < class keytype, typename hashtype, typename hashfn >
+int PrintCollisions ( hashfn hash, std::vector<keytype> & keys )
 {
   int collcount = 0;
 
@@ -320,6 +479,37 @@ int PrintCollisions ( hashfunc<hashtype> hash, std::vector<keytype> & keys )
 //----------------------------------------------------------------------------
 // Measure the distribution "score" for each possible N-bit span up to 20 bits
 
+// window() with the start wrapping around, word-wise for integer hashes
+// and Blobs
+
+template< typename hashtype >
+inline uint32_t DistWindow ( const hashtype & h, int start, int width )
+{
+  return window((void*)&h, sizeof(h), start, width);
+}
+
+inline uint32_t DistWindow ( uint32_t h, int start, int width )
+{
+  if(start) h = (h >> start) | (h << (32 - start));
+  return h & ((1u << width) - 1);
+}
+
+inline uint32_t DistWindow ( uint64_t h, int start, int width )
+{
+  if(start) h = (h >> start) | (h << (64 - start));
+  return (uint32_t)h & ((1u << width) - 1);
+}
+
+template< int _bits >
+inline uint32_t DistWindow ( const Blob<_bits> & h, int start, int width )
+{
+  return h.window(start, width);
+}
+
+// The start bits are binned in groups, each hash is loaded once per group
+// and its windows go to one bin array per start. The groups run on the
+// thread pool with per-thread bins; the scores are reported in order.
+
 template< typename hashtype >
 bool TestDistribution ( std::vector<hashtype> & hashes, bool drawDiagram )
 {
@@ -339,37 +529,68 @@ bool TestDistribution ( std::vector<hashtype> & hashes, bool drawDiagram )
     maxwidth--;
   }
 
-  std::vector<int> bins;
-  bins.resize(1 << maxwidth);
+  const int group = 4;
+  const int ngroups = (hashbits + group - 1) / group;
 
-  double worst = 0;
-  int worstStart = -1;
-  int worstWidth = -1;
+  // scores[start] for widths maxwidth down to 8
+  std::vector< std::vector<double> > scores(hashbits);
+  std::vector< std::vector<int> > threadbins(g_NCPU);
 
-  for(int start = 0; start < hashbits; start++)
+  ParallelFor(ngroups, g_NCPU, [&] ( size_t g, unsigned t )
   {
-    int width = maxwidth;
-    int bincount = (1 << width);
+    const int first = (int)g * group;
+    const int count = std::min(group, hashbits - first);
 
-    memset(&bins[0],0,sizeof(int)*bincount);
+    std::vector<int> & bins = threadbins[t];
+    bins.assign((size_t)group << maxwidth, 0);
 
     for(size_t j = 0; j < hashes.size(); j++)
     {
-      hashtype & hash = hashes[j];
-
-      uint32_t index = window(&hash,sizeof(hash),start,width);
+      const hashtype & hash = hashes[j];
 
-      bins[index]++;
+      for(int k = 0; k < count; k++)
+      {
+        bins[((size_t)k << maxwidth) + DistWindow(hash, first + k, maxwidth)]++;
+      }
     }
 
     // Test the distribution, then fold the bins in half,
     // repeat until we're down to 256 bins
 
+    for(int k = 0; k < count; k++)
+    {
+      int * b = &bins[(size_t)k << maxwidth];
+      int width = maxwidth;
+      int bincount = (1 << width);
+
+      while(bincount >= 256)
+      {
+        scores[first + k].push_back(calcScore(b,bincount,(int)hashes.size()));
+
+        width--;
+        bincount /= 2;
+
+        if(width < 8) break;
+
+        for(int i = 0; i < bincount; i++)
+        {
+          b[i] += b[i+bincount];
+        }
+      }
+    }
+  });
+
+  double worst = 0;
+  int worstStart = -1;
+  int worstWidth = -1;
+
+  for(int start = 0; start < hashbits; start++)
+  {
     if(drawDiagram) printf("[");
 
-    while(bincount >= 256)
+    for(size_t i = 0; i < scores[start].size(); i++)
     {
-      double n = calcScore(&bins[0],bincount,(int)hashes.size());
+      double n = scores[start][i];
 
       if(drawDiagram) plot(n);
 
@@ -377,17 +598,7 @@ bool TestDistribution ( std::vector<hashtype> & hashes, bool drawDiagram )
       {
         worst = n;
         worstStart = start;
-        worstWidth = width;
-      }
-
-      width--;
-      bincount /= 2;
-
-      if(width < 8) break;
-
-      for(int i = 0; i < bincount; i++)
-      {
-        bins[i] += bins[i+bincount];
+        worstWidth = maxwidth - (int)i;
       }
     }
 
@@ -425,20 +636,6 @@ static int FindNbBitsForCollisionTarget(int targetNbCollisions, int nbHashes)
     return nb-1;
 }
 
-// 0xf00f1001 => 0x8008f00f
-template <typename hashtype>
-hashtype bitreverse(hashtype n, size_t b = sizeof(hashtype) * 8)
-{
-    assert(b <= std::numeric_limits<hashtype>::digits);
-    hashtype rv = 0;
-    for (size_t i = 0; i < b; i += 8) {
-        rv <<= 8;
-        rv |= bitrev(n & 0xff); // ensure overloaded |= op for Blob not underflowing
-        n >>= 8;
-    }
-    return rv;
-}
-
 template < typename hashtype >
 bool TestHashList ( std::vector<hashtype> & hashes, bool drawDiagram,
                     bool testCollision = true, bool testDist = true,
@@ -486,47 +683,44 @@ bool TestHashList ( std::vector<hashtype> & hashes, bool drawDiagram,
 
     printf("\n");
 
+    std::vector<int> collcounts;
+
     if (testHighBits) {
-      result &= CountHighbitsCollisions(hashes, 224);
-      result &= CountHighbitsCollisions(hashes, 160);
-      result &= CountHighbitsCollisions(hashes, 128);
-      result &= CountHighbitsCollisions(hashes,  64);
-      result &= CountHighbitsCollisions(hashes,  32);
+      CountPrefixCollisions(hashes, collcounts);
+
+      result &= CountPrefixBitsCollisions("high", collcounts, count, 224);
+      result &= CountPrefixBitsCollisions("high", collcounts, count, 160);
+      result &= CountPrefixBitsCollisions("high", collcounts, count, 128);
+      result &= CountPrefixBitsCollisions("high", collcounts, count,  64);
+      result &= CountPrefixBitsCollisions("high", collcounts, count,  32);
 
       /*
         int const optimalNbBits = FindNbBitsForCollisionTarget(100, count);
-        result &= CountHighbitsCollisions(hashes, optimalNbBits);
+        result &= CountPrefixBitsCollisions("high", collcounts, count, optimalNbBits);
       */
 
-      result &= TestHighbitsCollisions(hashes);
-      result &= CountHighbitsCollisions(hashes,   12);
-      result &= CountHighbitsCollisions(hashes,   8);
+      result &= TestPrefixBitsCollisions("high", collcounts, count);
+      result &= CountPrefixBitsCollisions("high", collcounts, count,  12);
+      result &= CountPrefixBitsCollisions("high", collcounts, count,   8);
     }
     if (testLowBits) {
-      // reverse: bitwise flip the hashes. lowest bits first
-      std::vector<hashtype> revhashes = hashes;
-      for (size_t i = 0; i < revhashes.size(); i++) {
-        revhashes[i] = bitreverse(hashes[i]);
-      }
-      std::sort(revhashes.begin(), revhashes.end());
+      // collisions in the lowest bits, without a bit-reversed copy of the list
+      CountSuffixCollisions(hashes, collcounts);
 
-      result &= CountLowbitsCollisions(revhashes, 224);
-      result &= CountLowbitsCollisions(revhashes, 160);
-      result &= CountLowbitsCollisions(revhashes, 128);
-      result &= CountLowbitsCollisions(revhashes,  64);
-      result &= CountLowbitsCollisions(revhashes,  32);
+      result &= CountPrefixBitsCollisions("low ", collcounts, count, 224);
+      result &= CountPrefixBitsCollisions("low ", collcounts, count, 160);
+      result &= CountPrefixBitsCollisions("low ", collcounts, count, 128);
+      result &= CountPrefixBitsCollisions("low ", collcounts, count,  64);
+      result &= CountPrefixBitsCollisions("low ", collcounts, count,  32);
 
       /*
         int const optimalNbBits = FindNbBitsForCollisionTarget(100, count);
-        result &= CountLowbitsCollisions(hashes, optimalNbBits);
+        result &= CountPrefixBitsCollisions("low ", collcounts, count, optimalNbBits);
       */
 
-      result &= TestLowbitsCollisions(revhashes);
-      result &= CountLowbitsCollisions(revhashes,   12);
-      result &= CountLowbitsCollisions(revhashes,   8);
-
-      //std::vector<hashtype>().swap(revhashes);
-      //revhashes.clear();
+      result &= TestPrefixBitsCollisions("low ", collcounts, count);
+      result &= CountPrefixBitsCollisions("low ", collcounts, count,  12);
+      result &= CountPrefixBitsCollisions("low ", collcounts, count,   8);
     }
   }
 
@@ -543,8 +737,8 @@ bool TestHashList ( std::vector<hashtype> & hashes, bool drawDiagram,
 
 //-----------------------------------------------------------------------------
 
-template < class keytype, typename hashtype >
-bool TestKeyList ( hashfunc<hashtype> hash, std::vector<keytype> & keys,
+template < class keytype, typename hashtype, typename hashfn >
+bool TestKeyList ( hashfn hash, std::vector<keytype> & keys,
                    bool drawDiagram, bool testColl, bool testDist )
 {
   int keycount = (int)keys.size();
@@ -47,6 +47,10 @@ void MixVCode ( const void * blob, int len );
 typedef void (*pfHash)(const void *blob, const int len, const uint32_t seed,
                        void *out);
 
+// Hashes n keys per call, the results go to consecutive slots of outs
+typedef void (*pfHashBatch)(const void * const * keys, const int * lens,
+                            const uint32_t seed, void * outs, int n);
+
 enum HashQuality             {  SKIP,   POOR,   GOOD };
 struct HashInfo
 {
@@ -56,6 +60,8 @@ struct HashInfo
   const char * name;
   const char * desc;
   enum HashQuality quality;
+  void (*inlined)(HashInfo *); // runs the tests with the hash inlined, or NULL
+  pfHashBatch batch;            // native batch hash, or NULL
 };
 
 struct ByteVec : public std::vector<uint8_t>
@@ -84,7 +90,7 @@ class hashfunc
 {
 public:
 
-  hashfunc ( pfHash h ) : m_hash(h)
+  hashfunc ( pfHash h, pfHashBatch b = NULL ) : m_hash(h), m_batch(b)
   {
   }
 
@@ -111,7 +117,65 @@ public:
     return result;
   }
 
+  // n keys at a time, looping over the single-key hash if there is no
+  // native batch hash
+  inline void batch ( const void * const * keys, const int * lens, const uint32_t seed, T * outs, int n ) const
+  {
+    if(m_batch)
+    {
+      m_batch(keys,lens,seed,outs,n);
+      return;
+    }
+
+    for(int i = 0; i < n; i++) m_hash(keys[i],lens[i],seed,&outs[i]);
+  }
+
   pfHash m_hash;
+  pfHashBatch m_batch;
+};
+
+// The same interface with the hash bound at compile time. The test templates
+// take the hash as a functor type, so with this one they call it directly and
+// can inline it into the key loops instead of going through the pointer.
+
+template < class T, pfHash fn >
+class statichashfunc
+{
+public:
+
+  statichashfunc ( pfHashBatch b = NULL ) : m_batch(b)
+  {
+  }
+
+  inline void operator () ( const void * key, const int len, const uint32_t seed, void * out ) const
+  {
+    fn(key,len,seed,out);
+  }
+
+  inline operator pfHash ( void ) const
+  {
+    return fn;
+  }
+
+  inline T operator () ( const void * key, const int len, const uint32_t seed ) const
+  {
+    T result;
+    fn(key,len,seed,&result);
+    return result;
+  }
+
+  inline void batch ( const void * const * keys, const int * lens, const uint32_t seed, T * outs, int n ) const
+  {
+    if(m_batch)
+    {
+      m_batch(keys,lens,seed,outs,n);
+      return;
+    }
+
+    for(int i = 0; i < n; i++) fn(keys[i],lens[i],seed,&outs[i]);
+  }
+
+  pfHashBatch m_batch;
 };
 
 //-----------------------------------------------------------------------------
@@ -219,6 +283,11 @@ private:
 
 //-----------------------------------------------------------------------------
 
+// The bytes form a little-endian integer. Comparisons, bitwise operations,
+// shifts, popcount and windows load them into 64-bit words (memcpy, so
+// unaligned and odd sizes work) and work a word at a time; the compiler
+// vectorizes the word loops for the wide blobs.
+
 template < int _bits >
 class Blob
 {
@@ -226,18 +295,12 @@ public:
 
   Blob()
   {
-    for(size_t i = 0; i < sizeof(bytes); i++)
-    {
-      bytes[i] = 0;
-    }
+    memset(bytes, 0, sizeof(bytes));
   }
 
   Blob ( int x )
   {
-    for(size_t i = 0; i < sizeof(bytes); i++)
-    {
-      bytes[i] = 0;
-    }
+    memset(bytes, 0, sizeof(bytes));
     *(int*)bytes = x;
   }
   Blob ( unsigned long long x )
@@ -251,18 +314,12 @@ public:
 
   Blob ( const Blob & k )
   {
-    for(size_t i = 0; i < sizeof(bytes); i++)
-    {
-      bytes[i] = k.bytes[i];
-    }
+    memcpy(bytes, k.bytes, sizeof(bytes));
   }
 
   Blob & operator = ( const Blob & k )
   {
-    for(size_t i = 0; i < sizeof(bytes); i++)
-    {
-      bytes[i] = k.bytes[i];
-    }
+    memcpy(bytes, k.bytes, sizeof(bytes));
 
     return *this;
   }
@@ -305,10 +362,13 @@ public:
 
   bool operator < ( const Blob & k ) const
   {
-    for(int i = sizeof(bytes) -1; i >= 0; i--)
+    uint64_t a[nwords], b[nwords];
+    load(a);
+    k.load(b);
+
+    for(int i = nwords - 1; i >= 0; i--)
     {
-      if(bytes[i] < k.bytes[i]) return true;
-      if(bytes[i] > k.bytes[i]) return false;
+      if(a[i] != b[i]) return a[i] < b[i];
     }
 
     return false;
@@ -316,12 +376,7 @@ public:
 
   bool operator == ( const Blob & k ) const
   {
-    for(size_t i = 0; i < sizeof(bytes); i++)
-    {
-      if(bytes[i] != k.bytes[i]) return false;
-    }
-
-    return true;
+    return memcmp(bytes, k.bytes, sizeof(bytes)) == 0;
   }
 
   bool operator != ( const Blob & k ) const
@@ -334,22 +389,20 @@ public:
 
   Blob operator ^ ( const Blob & k ) const
   {
-    Blob t;
-
-    for(size_t i = 0; i < sizeof(bytes); i++)
-    {
-      t.bytes[i] = bytes[i] ^ k.bytes[i];
-    }
-
+    Blob t = *this;
+    t ^= k;
     return t;
   }
 
   Blob & operator ^= ( const Blob & k )
   {
-    for(size_t i = 0; i < sizeof(bytes); i++)
-    {
-      bytes[i] ^= k.bytes[i];
-    }
+    uint64_t a[nwords], b[nwords];
+    load(a);
+    k.load(b);
+
+    for(int i = 0; i < nwords; i++) a[i] ^= b[i];
+
+    store(a);
     return *this;
   }
 
@@ -364,10 +417,13 @@ public:
 
   Blob & operator |= ( const Blob & k )
   {
-    for(size_t i = 0; i < sizeof(bytes); i++)
-    {
-      bytes[i] |= k.bytes[i];
-    }
+    uint64_t a[nwords], b[nwords];
+    load(a);
+    k.load(b);
+
+    for(int i = 0; i < nwords; i++) a[i] |= b[i];
+
+    store(a);
     return *this;
   }
   Blob & operator |= ( uint8_t k )
@@ -378,42 +434,67 @@ public:
 
   Blob & operator &= ( const Blob & k )
   {
-    for(size_t i = 0; i < sizeof(bytes); i++)
-    {
-      bytes[i] &= k.bytes[i];
-    }
+    uint64_t a[nwords], b[nwords];
+    load(a);
+    k.load(b);
+
+    for(int i = 0; i < nwords; i++) a[i] &= b[i];
+
+    store(a);
     return *this;
   }
 
   Blob operator << ( int c )
   {
     Blob t = *this;
-
-    lshift(&t.bytes[0], sizeof(bytes), c);
-
+    t <<= c;
     return t;
   }
 
   Blob operator >> ( int c )
   {
     Blob t = *this;
-
-    rshift(&t.bytes[0], sizeof(bytes), c);
-
+    t >>= c;
     return t;
   }
 
   Blob & operator <<= ( int c )
   {
-    lshift(&bytes[0], sizeof(bytes), c);
+    uint64_t a[nwords];
+    load(a);
+
+    const int w = c / 64;
+    c &= 63;
+
+    for(int i = nwords - 1; i >= 0; i--)
+    {
+      uint64_t hi = (i - w >= 0) ? a[i - w] : 0;
+      uint64_t lo = (i - w - 1 >= 0) ? a[i - w - 1] : 0;
+
+      a[i] = c ? (hi << c) | (lo >> (64 - c)) : hi;
+    }
 
+    store(a);
     return *this;
   }
 
   Blob & operator >>= ( int c )
   {
-    rshift(&bytes[0], sizeof(bytes), c);
+    uint64_t a[nwords];
+    load(a);
 
+    const int w = c / 64;
+    c &= 63;
+
+    for(int i = 0; i < nwords; i++)
+    {
+      uint64_t lo = (i + w < nwords) ? a[i + w] : 0;
+      uint64_t hi = (i + w + 1 < nwords) ? a[i + w + 1] : 0;
+
+      a[i] = c ? (lo >> c) | (hi << (64 - c)) : lo;
+    }
+
+    store(a);
     return *this;
   }
 
@@ -427,10 +508,91 @@ public:
     return *this;
   }
 
+  int popcount ( void ) const
+  {
+    uint64_t a[nwords];
+    load(a);
+
+    int n = 0;
+    for(int i = 0; i < nwords; i++) n += (int)popcount8(a[i]);
+    return n;
+  }
+
+  // the highest bits which are equal in both
+
+  int commonprefix ( const Blob & k ) const
+  {
+    uint64_t a[nwords], b[nwords];
+    load(a);
+    k.load(b);
+
+    // the zero padding above the bytes in the top word
+    const int pad = nwords * 64 - (int)sizeof(bytes) * 8;
+
+    for(int i = nwords - 1; i >= 0; i--)
+    {
+      uint64_t x = a[i] ^ b[i];
+      if(x) return (nwords - 1 - i) * 64 + clz8(x) - pad;
+    }
+
+    return sizeof(bytes) * 8;
+  }
+
+  // count (<= 32) bits from bit start on, wrapping around like window()
+
+  uint32_t window ( int start, int count ) const
+  {
+    const int nbits = sizeof(bytes) * 8;
+
+    uint64_t a[nwords];
+    load(a);
+
+    start %= nbits;
+
+    uint64_t t = extract(a, start, count);
+
+    if(start + count > nbits)
+    {
+      t |= extract(a, 0, start + count - nbits) << (nbits - start);
+    }
+
+    return (uint32_t)(t & ((uint64_t(1) << count) - 1));
+  }
+
   //----------
 
 private:
 
+  enum { nwords = ((_bits+7)/8 + 7) / 8 };
+
+  // the bytes as little-endian words, zero-padded
+  inline void load ( uint64_t * a ) const
+  {
+    a[nwords-1] = 0;
+    memcpy(a, bytes, sizeof(bytes));
+  }
+
+  inline void store ( const uint64_t * a )
+  {
+    memcpy(bytes, a, sizeof(bytes));
+  }
+
+  // up to 64 bits from bit start on, without wrapping
+  static inline uint64_t extract ( const uint64_t * a, int start, int count )
+  {
+    const int w = start / 64;
+    const int c = start & 63;
+
+    uint64_t t = a[w] >> c;
+
+    if(c && c + count > 64 && w + 1 < nwords)
+    {
+      t |= a[w + 1] << (64 - c);
+    }
+
+    return t;
+  }
+
   uint8_t bytes[(_bits+7)/8];
 };
 
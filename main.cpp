@@ -6,6 +6,7 @@
 #include "AvalancheTest.h"
 #include "DifferentialTest.h"
 #include "HashMapTest.h"
+#include "Parallel.h"
 
 #include <stdio.h>
 #include <stdint.h>
@@ -22,6 +23,10 @@ bool g_testVerifyAll   = false;
 bool g_testSanity      = false;
 bool g_testSpeed       = false;
 bool g_testHashmap     = false;
+bool g_testBulkSweep   = false; // cache and DRAM sweep, only on request
+bool g_testScaling     = false; // all CPUs at once, only on request
+bool g_testHashmapConcurrent = false; // shared map, only on request
+bool g_testHashmapProfiles = false; // workload and load factor sweep, only on request
 bool g_testAvalanche   = false;
 bool g_testSparse      = false;
 bool g_testPermutation = false;
@@ -38,6 +43,11 @@ bool g_testBIC         = false;
 //bool g_testLongNeighbors = false;
 
 double g_speed = 0.0;
+const char * g_keysizes = NULL; // key size distribution for the throughput test
+const char * g_keys     = NULL; // --keys= of the hashmap tests
+HashMapProfile g_profile;       // --profile= of the hashmap profiles
+bool g_customProfile    = false;
+std::vector<int> g_cpus;        // --cpu=N or --cpus=list, empty if not given
 
 struct TestOpts {
   bool         &var;
@@ -50,6 +60,10 @@ TestOpts g_testopts[] =
   { g_testSanity,       "Sanity" },
   { g_testSpeed,        "Speed" },
   { g_testHashmap,      "Hashmap" },
+  { g_testBulkSweep,    "BulkSweep" },
+  { g_testScaling,      "Scaling" },
+  { g_testHashmapConcurrent, "HashmapConcurrent" },
+  { g_testHashmapProfiles, "HashmapProfiles" },
   { g_testAvalanche,    "Avalanche" },
   { g_testSparse,       "Sparse" },
   { g_testPermutation,  "Permutation" },
@@ -73,6 +87,17 @@ bool MomentChi2Test ( struct HashInfo *info );
 
 const char* quality_str[3] = { "SKIP", "POOR", "GOOD" };
 
+// Cheap hashes spend much of the keyset tests in the call itself. These are
+// registered with INLINED(), which instantiates the tests with the hash as a
+// compile-time functor, the others go through the function pointer. A
+// native batch hash (pfHashBatch) goes after that, the keyset tests feed
+// their keys to it.
+
+template < typename hashtype, pfHash fn >
+void testInlined ( HashInfo * info );
+
+#define INLINED(hashtype, fn) testInlined< hashtype, fn >
+
 // sorted by quality and speed
 HashInfo g_hashes[] =
 {
@@ -154,7 +179,7 @@ HashInfo g_hashes[] =
 #endif
 #if defined(__SSE4_2__) && defined(__x86_64__)
   /* Even 32 uses crc32q, quad only */
-  { crc32c_hw_test,       32, 0x0C7346F0, "crc32_hw",    "SSE4.2 crc32 in HW", POOR },
+  { crc32c_hw_test,       32, 0x0C7346F0, "crc32_hw",    "SSE4.2 crc32 in HW", POOR, INLINED(uint32_t, crc32c_hw_test) },
   { crc32c_hw1_test,      32, 0x0C7346F0, "crc32_hw1",   "Faster Adler SSE4.2 crc32 in HW", POOR },
   { crc64c_hw_test,       64, 0xE7C3FD0E, "crc64_hw",    "SSE4.2 crc64 in HW", POOR },
 #endif
@@ -167,7 +192,7 @@ HashInfo g_hashes[] =
   { fhtw_test,            64, 0x0,        "fhtw",        "fhtw asm", POOR },
 #endif
   { fibonacci_test, __WORDSIZE, FIBONACCI_VERIF, "fibonacci",   "wordwise Fibonacci", POOR },
-  { FNV32a_test,          32, 0xE3CBBE91, "FNV1a",       "Fowler-Noll-Vo hash, 32-bit", POOR },
+  { FNV32a_test,          32, 0xE3CBBE91, "FNV1a",       "Fowler-Noll-Vo hash, 32-bit", POOR, INLINED(uint32_t, FNV32a_test), FNV32a_batch },
 #ifdef HAVE_INT64
   { FNV1A_Totenschiff_test,32,0x95D95ACF, "FNV1A_Totenschiff",  "FNV1A_Totenschiff_v1 64-bit sanmayce", POOR },
   { FNV1A_PY_test,        32, 0xE79AE3E4, "FNV1A_Pippip_Yurii", "FNV1A-Pippip_Yurii 32-bit sanmayce", POOR },
@@ -250,7 +275,7 @@ HashInfo g_hashes[] =
   { t1ha1_64be_test,      64, 0x93F864DE, "t1ha1_64be",  "Fast Positive Hash (portable, aims 64-bit, big-engian)", POOR },
   { t1ha0_32le_test,      64, 0x7F7D7B29, "t1ha0_32le",  "Fast Positive Hash (portable, aims 32-bit, little-endian)", POOR },
   { t1ha0_32be_test,      64, 0xDA6A4061, "t1ha0_32be",  "Fast Positive Hash (portable, aims 32-bit, big-endian)", POOR },
-  { xxh3_test,            64, 0x5921E69E, "xxh3",        "xxHash v3, 64-bit", POOR },
+  { xxh3_test,            64, 0x5921E69E, "xxh3",        "xxHash v3, 64-bit", POOR, INLINED(uint64_t, xxh3_test) },
   { xxh3low_test,         32, 0xAC902311, "xxh3low",     "xxHash v3, 64-bit, low 32-bits part", POOR },
   { xxh128_test,         128, 0x80E5D1DF, "xxh128",      "xxHash v3, 128-bit", POOR },
   { xxh128low_test,       64, 0xB1BB6A50, "xxh128low",   "xxHash v3, 128-bit, low 64-bits part", POOR },
@@ -375,7 +400,7 @@ HashInfo g_hashes[] =
 # ifdef DEBUG
   { wysha,                 32, 0xD09A85B3, "wysha",          "wyhash v4 test", GOOD },
 # endif
-  { wyhash_test,           64, WYHASH_VERIF, "wyhash",          "wyhash v4 (64-bit, little-endian)", GOOD },
+  { wyhash_test,           64, WYHASH_VERIF, "wyhash",          "wyhash v4 (64-bit, little-endian)", GOOD, INLINED(uint64_t, wyhash_test) },
   { wyhash32low,           32, WYHASH32L_VERIF,"wyhash32low",   "wyhash v4 - lower 32bit", GOOD }
 #else
   { NULL }
@@ -447,11 +472,16 @@ void SelfTest(bool verbose) {
 
 //----------------------------------------------------------------------------
 
-template < typename hashtype >
-void test ( hashfunc<hashtype> hash, HashInfo* info )
+template < typename hashtype, typename hashfn >
+void test ( hashfn hash, HashInfo* info )
 {
   const int hashbits = sizeof(hashtype) * 8;
 
+  // the single-threaded tests measure on the first of the --cpus, the
+  // multi-threaded ones pin their threads to all of them
+  if (!g_cpus.empty())
+    PinThread(g_cpus[0]);
+
   if (g_testAll) {
     printf("-------------------------------------------------------------------------------\n");
   }
@@ -469,7 +499,8 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
     printf("PASS\n\n"); fflush(NULL); // if not it does exit(1)
   }
 
-  if (g_testAll || g_testSpeed || g_testHashmap) {
+  if (g_testAll || g_testSpeed || g_testHashmap || g_testBulkSweep || g_testScaling ||
+      g_testHashmapConcurrent || g_testHashmapProfiles) {
     printf("--- Testing %s \"%s\" %s\n\n", info->name, info->desc, quality_str[info->quality]);
   } else {
     fprintf(stderr, "--- Testing %s \"%s\" %s\n\n", info->name, info->desc, quality_str[info->quality]);
@@ -485,6 +516,8 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
     VerificationTest(hash,hashbits,info->verification,true);
     SanityTest(hash,hashbits);
     AppendedZeroesTest(hash,hashbits);
+    if(info->batch)
+      BatchSanityTest(hash,info->batch,hashbits);
     printf("\n");
     fflush(NULL);
   }
@@ -502,12 +535,42 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
     printf("\n");
     fflush(NULL);
 
+    // latency of dependent calls, then the throughput of independent keys
+    // of the same size, through the batch hash too if there is one
+    double sumIndep = 0.0;
+    PerfCounts perf;
+    PerfClear(perf);
     for(int i = 1; i < 32; i++)
     {
-      sum += TinySpeedTest(hashfunc<hashtype>(info->hash),sizeof(hashtype),i,info->verification,true);
+      std::vector<int> keysizes(1, i);
+      sum += TinySpeedTest(hashfunc<hashtype>(info->hash),sizeof(hashtype),i,info->verification,true,&perf);
+      double indep = ThroughputSpeedTest(info->hash,NULL,sizeof(hashtype),keysizes,info->verification);
+      printf(", %8.2f independent", indep);
+      if(info->batch)
+        printf(", %8.2f batched",
+               ThroughputSpeedTest(info->hash,info->batch,sizeof(hashtype),keysizes,info->verification));
+      printf("\n");
+      sumIndep += indep;
     }
     g_speed = sum = sum / 31.0;
     printf("Average                                    %6.3f cycles/hash\n",sum);
+    PerfReport(perf, "hash");
+    printf("Average, independent keys                  %6.3f cycles/hash\n",sumIndep / 31.0);
+    printf("\n");
+
+    // independent keys of mixed sizes, and the --keysizes distribution
+    const char * mixes[] = { "1-16", "1-64", "1-256", g_keysizes };
+    for(size_t i = 0; i < sizeof(mixes) / sizeof(mixes[0]) && mixes[i]; i++)
+    {
+      std::vector<int> keysizes;
+      ParseKeySizes(mixes[i], keysizes);
+      printf("Independent keys, sizes %-18s - %8.2f cycles/hash", mixes[i],
+             ThroughputSpeedTest(info->hash,NULL,sizeof(hashtype),keysizes,info->verification));
+      if(info->batch)
+        printf(", %8.2f batched",
+               ThroughputSpeedTest(info->hash,info->batch,sizeof(hashtype),keysizes,info->verification));
+      printf("\n");
+    }
     printf("\n");
     fflush(NULL);
   } else {
@@ -547,6 +610,23 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
     }
   }
 
+  // not part of All: up to 1 GiB working sets, cold and warm
+  if(g_testBulkSweep)
+  {
+    printf("[[[ Bulk Sweep Speed Tests ]]]\n\n");
+    BulkSweepTest(info->hash,info->verification);
+    printf("\n");
+    fflush(NULL);
+  }
+
+  // not part of All: depends on the machine, --threads=N caps the threads
+  if(g_testScaling)
+  {
+    printf("[[[ Multi-core Scaling Speed Tests ]]]\n\n");
+    ScalingSpeedTest(info->hash,info->verification,g_NCPU > 1 ? g_NCPU : 0);
+    fflush(NULL);
+  }
+
   // sha1_32a runs 30s
   if(g_testHashmap || g_testAll)
   {
@@ -560,21 +640,62 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
     if (info->quality == SKIP) {
       result = false;
     } else {
-      std::vector<std::string> words = HashMapInit(g_drawDiagram);
-      result &= HashMapTest(hash,info->hashbits,words,trials,g_drawDiagram);
+      HashMapWords words;
+      if (HashMapInit(words, g_keys, g_drawDiagram)) {
+        result &= HashMapTest(hash,info->hashbits,words,trials,g_drawDiagram);
+        result &= HashMapInlinedTest<hashtype>(hash,words,trials);
+      } else {
+        result = false;
+      }
     }
     if(!result) printf("*********FAIL*********\n");
     printf("\n");
     fflush(NULL);
   }
 
+  // not part of All: depends on the machine, --threads=N caps the threads
+  if(g_testHashmapConcurrent)
+  {
+    printf("[[[ 'Hashmap' Concurrent Speed Tests ]]]\n\n");
+    fflush(NULL);
+    HashMapWords words;
+    if (HashMapInit(words, g_keys, g_drawDiagram))
+      HashMapConcurrentTest<hashtype>(hash,words,g_NCPU > 1 ? g_NCPU : 0);
+    else
+      printf("*********FAIL*********\n");
+    printf("\n");
+    fflush(NULL);
+  }
+
+  // not part of All: hit/miss, operation mix and load factor, --profile= adds one
+  if(g_testHashmapProfiles)
+  {
+    printf("[[[ 'Hashmap' Workload Profiles ]]]\n\n");
+    fflush(NULL);
+    HashMapWords words;
+    if (HashMapInit(words, g_keys, g_drawDiagram))
+      HashMapProfileTest<hashtype>(hash,words,g_customProfile ? &g_profile : NULL);
+    else
+      printf("*********FAIL*********\n");
+    printf("\n");
+    fflush(NULL);
+  }
+
+  //-----------------------------------------------------------------------------
+  // The remaining test families are independent of each other. They are
+  // queued as tasks and run concurrently with --threads=N, in forked worker
+  // processes which replay their output in this order. Speed and Hashmap
+  // above stay serial, they must not compete with other tests for the CPU.
+
+  std::vector<TestTask> tasks;
+
   //-----------------------------------------------------------------------------
   // Avalanche tests
   // 1m30 for xxh3
   // 13m  for xxh3 with --extra
   // 3m   for farmhash128_c (was 7m with 512,1024)
 
-  if(g_testAvalanche || g_testAll)
+  if(g_testAvalanche || g_testAll) tasks.push_back([=]()
   {
     printf("[[[ Avalanche Tests ]]]\n\n");
     fflush(NULL);
@@ -624,7 +745,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
     if(!result) printf("*********FAIL*********\n");
     printf("\n");
     fflush(NULL);
-  }
+  });
 
   //-----------------------------------------------------------------------------
   // Keyset 'Sparse' - keys with all bits 0 except a few
@@ -632,7 +753,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
   // 14m  for xxh3 with --extra
   // 6m30 for farmhash128_c (was too much with >= 512)
 
-  if(g_testSparse || g_testAll)
+  if(g_testSparse || g_testAll) tasks.push_back([=]()
   {
     printf("[[[ Keyset 'Sparse' Tests ]]]\n\n");
     fflush(NULL);
@@ -690,7 +811,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
     if(!result) printf("*********FAIL*********\n");
     printf("\n");
     fflush(NULL);
-  }
+  });
 
   //-----------------------------------------------------------------------------
   // Keyset 'Permutation' - all possible combinations of a set of blocks
@@ -698,7 +819,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
   // 120m for farmhash128_c with maxlen=18, 1m20 FAIL with maxlen=12
   //                                        1m20 PASS with maxlen=14,16,17
 
-  if(g_testPermutation || g_testAll)
+  if(g_testPermutation || g_testAll) tasks.push_back([=]()
   {
     const int maxlen = g_testExtra
       ? 23
@@ -737,7 +858,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
         0x20000000, 0x40000000, 0x60000000, 0x80000000, 0xA0000000, 0xC0000000, 0xE0000000
       };
 
-      result &= CombinationKeyTest(hash,7,blocks,sizeof(blocks) / sizeof(uint32_t),
+      result &= CombinationKeyTest<hashtype>(hash,7,blocks,sizeof(blocks) / sizeof(uint32_t),
                                    true,true, g_drawDiagram);
 
       if(!result) printf("*********FAIL*********\n");
@@ -777,7 +898,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
         0x80000000,
       };
 
-      result &= CombinationKeyTest(hash, maxlen, blocks, sizeof(blocks) / sizeof(uint32_t),
+      result &= CombinationKeyTest<hashtype>(hash, maxlen, blocks, sizeof(blocks) / sizeof(uint32_t),
                                    true,true, g_drawDiagram);
 
       if(!result) printf("*********FAIL*********\n");
@@ -796,7 +917,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
         0x00000001,
       };
 
-      result &= CombinationKeyTest(hash, maxlen, blocks, sizeof(blocks) / sizeof(uint32_t),
+      result &= CombinationKeyTest<hashtype>(hash, maxlen, blocks, sizeof(blocks) / sizeof(uint32_t),
                                    true, true, g_drawDiagram);
 
       if(!result) printf("*********FAIL*********\n");
@@ -816,7 +937,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
         0x8000000000000000ULL,
       };
 
-      result &= CombinationKeyTest(hash, maxlen, blocks, sizeof(blocks) / sizeof(uint64_t),
+      result &= CombinationKeyTest<hashtype>(hash, maxlen, blocks, sizeof(blocks) / sizeof(uint64_t),
                                    true, true, g_drawDiagram);
 
       if(!result) printf("*********FAIL*********\n");
@@ -836,7 +957,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
         0x0000000000000001ULL,
       };
 
-      result &= CombinationKeyTest(hash, maxlen, blocks, sizeof(blocks) / sizeof(uint64_t),
+      result &= CombinationKeyTest<hashtype>(hash, maxlen, blocks, sizeof(blocks) / sizeof(uint64_t),
                                    true, true, g_drawDiagram);
 
       if(!result) printf("*********FAIL*********\n");
@@ -854,7 +975,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
       memset(blocks, 0, sizeof(blocks));
       blocks[0].c[0] = 1;   // presumes little endian
 
-      result &= CombinationKeyTest(hash, maxlen, blocks, 2, true, true, g_drawDiagram);
+      result &= CombinationKeyTest<hashtype>(hash, maxlen, blocks, 2, true, true, g_drawDiagram);
 
       if(!result) printf("*********FAIL*********\n");
       printf("\n");
@@ -872,7 +993,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
       memset(blocks, 0, sizeof(blocks));
       blocks[0].c[sizeof(blocks[0].c)-1] = 0x80;   // presumes little endian
 
-      result &= CombinationKeyTest(hash, maxlen, blocks, nbElts, true, true, g_drawDiagram);
+      result &= CombinationKeyTest<hashtype>(hash, maxlen, blocks, nbElts, true, true, g_drawDiagram);
 
       if(!result) printf("*********FAIL*********\n");
       printf("\n");
@@ -889,7 +1010,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
       memset(blocks, 0, sizeof(blocks));
       blocks[0].c[0] = 1;   // presumes little endian
 
-      result &= CombinationKeyTest(hash, maxlen, blocks, 2, true, true, g_drawDiagram);
+      result &= CombinationKeyTest<hashtype>(hash, maxlen, blocks, 2, true, true, g_drawDiagram);
 
       if(!result) printf("*********FAIL*********\n");
       printf("\n");
@@ -907,7 +1028,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
       memset(blocks, 0, sizeof(blocks));
       blocks[0].c[sizeof(blocks[0].c)-1] = 0x80;   // presumes little endian
 
-      result &= CombinationKeyTest(hash, maxlen, blocks, nbElts, true, true, g_drawDiagram);
+      result &= CombinationKeyTest<hashtype>(hash, maxlen, blocks, nbElts, true, true, g_drawDiagram);
 
       if(!result) printf("*********FAIL*********\n");
       printf("\n");
@@ -924,7 +1045,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
       memset(blocks, 0, sizeof(blocks));
       blocks[0].c[0] = 1;   // presumes little endian
 
-      result &= CombinationKeyTest(hash, maxlen, blocks, 2, true, true, g_drawDiagram);
+      result &= CombinationKeyTest<hashtype>(hash, maxlen, blocks, 2, true, true, g_drawDiagram);
 
       if(!result) printf("*********FAIL*********\n");
       printf("\n");
@@ -942,7 +1063,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
       memset(blocks, 0, sizeof(blocks));
       blocks[0].c[sizeof(blocks[0].c)-1] = 0x80;   // presumes little endian
 
-      result &= CombinationKeyTest(hash, maxlen, blocks, nbElts, true, true, g_drawDiagram);
+      result &= CombinationKeyTest<hashtype>(hash, maxlen, blocks, nbElts, true, true, g_drawDiagram);
 
       if(!result) printf("*********FAIL*********\n");
       printf("\n");
@@ -959,7 +1080,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
       memset(blocks, 0, sizeof(blocks));
       blocks[0].c[0] = 1;   // presumes little endian
 
-      result &= CombinationKeyTest(hash, maxlen, blocks, 2, true, true, g_drawDiagram);
+      result &= CombinationKeyTest<hashtype>(hash, maxlen, blocks, 2, true, true, g_drawDiagram);
 
       if(!result) printf("*********FAIL*********\n");
       printf("\n");
@@ -977,14 +1098,14 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
       memset(blocks, 0, sizeof(blocks));
       blocks[0].c[sizeof(blocks[0].c)-1] = 0x80;   // presumes little endian
 
-      result &= CombinationKeyTest(hash, maxlen, blocks, nbElts, true, true, g_drawDiagram);
+      result &= CombinationKeyTest<hashtype>(hash, maxlen, blocks, nbElts, true, true, g_drawDiagram);
 
       if(!result) printf("*********FAIL*********\n");
       printf("\n");
       fflush(NULL);
     }
 
-  }
+  });
 
   //-----------------------------------------------------------------------------
   // Keyset 'Window'
@@ -998,7 +1119,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
   // 7m for FNV64 with windowbits=27 / 32bit keys
   // 5m35 for hasshe2 with windowbits=25 / 32bit keys
 
-  if(g_testWindow || g_testAll)
+  if(g_testWindow || g_testAll) tasks.push_back([=]()
   {
     printf("[[[ Keyset 'Window' Tests ]]]\n\n");
 
@@ -1017,14 +1138,14 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
     if(!result) printf("*********FAIL*********\n");
     printf("\n");
     fflush(NULL);
-  }
+  });
 
   //-----------------------------------------------------------------------------
   // Keyset 'Cyclic' - keys of the form "abcdabcdabcd..."
   // 5s for crc32_hw
   // 18s for farmhash128_c
 
-  if(g_testCyclic || g_testAll)
+  if(g_testCyclic || g_testAll) tasks.push_back([=]()
   {
     printf("[[[ Keyset 'Cyclic' Tests ]]]\n\n");
     fflush(NULL);
@@ -1045,7 +1166,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
     if(!result) printf("*********FAIL*********\n");
     printf("\n");
     fflush(NULL);
-  }
+  });
 
   //-----------------------------------------------------------------------------
   // Keyset 'TwoBytes' - all keys up to N bytes containing two non-zero bytes
@@ -1057,7 +1178,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
   // With --extra this generates some huge keysets,
   // 128-bit tests will take ~1.3 gigs of RAM.
 
-  if(g_testTwoBytes || g_testAll)
+  if(g_testTwoBytes || g_testAll) tasks.push_back([=]()
   {
     printf("[[[ Keyset 'TwoBytes' Tests ]]]\n\n");
     fflush(NULL);
@@ -1078,12 +1199,12 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
     if(!result) printf("*********FAIL*********\n");
     printf("\n");
     fflush(NULL);
-  }
+  });
 
   //-----------------------------------------------------------------------------
   // Keyset 'Text'
 
-  if(g_testText || g_testAll)
+  if(g_testText || g_testAll) tasks.push_back([=]()
   {
     printf("[[[ Keyset 'Text' Tests ]]]\n\n");
 
@@ -1091,19 +1212,19 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
 
     const char * alnum = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
 
-    result &= TextKeyTest( hash, "Foo",    alnum, 4, "Bar",    g_drawDiagram );
-    result &= TextKeyTest( hash, "FooBar", alnum, 4, "",       g_drawDiagram );
-    result &= TextKeyTest( hash, "",       alnum, 4, "FooBar", g_drawDiagram );
+    result &= TextKeyTest<hashtype>( hash, "Foo",    alnum, 4, "Bar",    g_drawDiagram );
+    result &= TextKeyTest<hashtype>( hash, "FooBar", alnum, 4, "",       g_drawDiagram );
+    result &= TextKeyTest<hashtype>( hash, "",       alnum, 4, "FooBar", g_drawDiagram );
 
     if(!result) printf("*********FAIL*********\n");
     printf("\n");
     fflush(NULL);
-  }
+  });
 
   //-----------------------------------------------------------------------------
   // Keyset 'Zeroes'
 
-  if(g_testZeroes || g_testAll)
+  if(g_testZeroes || g_testAll) tasks.push_back([=]()
   {
     printf("[[[ Keyset 'Zeroes' Tests ]]]\n\n");
 
@@ -1114,12 +1235,12 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
     if(!result) printf("*********FAIL*********\n");
     printf("\n");
     fflush(NULL);
-  }
+  });
 
   //-----------------------------------------------------------------------------
   // Keyset 'Seed'
 
-  if(g_testSeed || g_testAll)
+  if(g_testSeed || g_testAll) tasks.push_back([=]()
   {
     printf("[[[ Keyset 'Seed' Tests ]]]\n\n");
 
@@ -1130,7 +1251,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
     if(!result) printf("*********FAIL*********\n");
     printf("\n");
     fflush(NULL);
-  }
+  });
 
   //-----------------------------------------------------------------------------
   // Differential tests
@@ -1138,7 +1259,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
   // less reps with slow hashes
   // md5: 1h38m with 1000 reps!
 
-  if(g_testDiff || g_testAll)
+  if(g_testDiff || g_testAll) tasks.push_back([=]()
   {
     printf("[[[ Diff 'Differential' Tests ]]]\n\n");
     fflush(NULL);
@@ -1158,13 +1279,13 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
     if(!result) printf("*********FAIL*********\n");
     printf("\n");
     fflush(NULL);
-  }
+  });
 
   //-----------------------------------------------------------------------------
   // Differential-distribution tests
   // 2m40 with xxh3
 
-  if(g_testDiffDist || g_testAll)
+  if(g_testDiffDist || g_testAll) tasks.push_back([=]()
   {
     printf("[[[ DiffDist 'Differential Distribution' Tests ]]]\n\n");
     fflush(NULL);
@@ -1176,7 +1297,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
     if(!result) printf("*********FAIL*********\n");
     printf("\n");
     fflush(NULL);
-  }
+  });
 
   // Moment Chi-Square test, measuring the probability of the
   // lowest 32 bits set over the whole key space. Not where the bits are, but how many.
@@ -1190,7 +1311,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
   //   7     35s
   //   13    20s
   //   16    12s
-  if(g_testMomentChi2 || g_testAll)
+  if(g_testMomentChi2 || g_testAll) tasks.push_back([=]()
   {
     printf("[[[ MomentChi2 Tests ]]]\n\n");
 
@@ -1200,7 +1321,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
     if(!result) printf("\n*********FAIL*********\n");
     printf("\n");
     fflush(NULL);
-  }
+  });
 
   //-----------------------------------------------------------------------------
   // LongNeighbors - collisions between long messages of low Hamming distance
@@ -1212,7 +1333,7 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
 
   // Not yet included for licensing reasons
 #if 0
-  if(g_testLongNeighbors || (g_testAll && g_testExtra))
+  if(g_testLongNeighbors || (g_testAll && g_testExtra)) tasks.push_back([=]()
   {
     printf("[[[ LongNeighbors Tests ]]]\n\n");
 
@@ -1223,16 +1344,16 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
     if(!result) printf("*********FAIL*********\n");
     printf("\n");
     fflush(NULL);
-  }
+  });
 #endif
 
   //-----------------------------------------------------------------------------
   // Bit Independence Criteria. Interesting, but doesn't tell us much about
-  // collision or distribution. For 128bit hashes only with --extra
-  // 4m with xxh3
+  // collision or distribution. For >64bit hashes by default, else on request.
+  // 4m with xxh3 (5s bit-sliced)
   // 152m with farmhash128_c with reps=1000000, => 8m with 100000
 
-  if(g_testBIC || (info->hashbits > 64 && g_testExtra))
+  if(g_testBIC || (info->hashbits > 64 && (g_testAll || g_testExtra))) tasks.push_back([=]()
   {
     printf("[[[ BIC 'Bit Independence Criteria' Tests ]]]\n\n");
     fflush(NULL);
@@ -1249,8 +1370,18 @@ void test ( hashfunc<hashtype> hash, HashInfo* info )
     if(!result) printf("\n*********FAIL*********\n");
     printf("\n");
     fflush(NULL);
-  }
-  
+  });
+
+  // the workers inherit the affinity of this thread
+  if (!g_cpus.empty())
+    SetAffinity(g_cpus);
+  RunTestTasks(tasks, g_NCPU);
+}
+
+template < typename hashtype, pfHash fn >
+void testInlined ( HashInfo * info )
+{
+  test<hashtype>( statichashfunc<hashtype, fn>(info->batch), info );
 }
 
 //-----------------------------------------------------------------------------
@@ -1337,29 +1468,33 @@ void testHash ( const char * name )
   {
     g_hashUnderTest = pInfo;
 
-    if(pInfo->hashbits == 32)
+    if(pInfo->inlined)
     {
-      test<uint32_t>( pInfo->hash, pInfo );
+      pInfo->inlined( pInfo );
+    }
+    else if(pInfo->hashbits == 32)
+    {
+      test<uint32_t>( hashfunc<uint32_t>(pInfo->hash, pInfo->batch), pInfo );
     }
     else if(pInfo->hashbits == 64)
     {
-      test<uint64_t>( pInfo->hash, pInfo );
+      test<uint64_t>( hashfunc<uint64_t>(pInfo->hash, pInfo->batch), pInfo );
     }
     else if(pInfo->hashbits == 128)
     {
-      test<uint128_t>( pInfo->hash, pInfo );
+      test<uint128_t>( hashfunc<uint128_t>(pInfo->hash, pInfo->batch), pInfo );
     }
     else if(pInfo->hashbits == 160)
     {
-      test<Blob<160>>( pInfo->hash, pInfo );
+      test<Blob<160>>( hashfunc<Blob<160>>(pInfo->hash, pInfo->batch), pInfo );
     }
     else if(pInfo->hashbits == 224)
     {
-      test<Blob<224>>( pInfo->hash, pInfo );
+      test<Blob<224>>( hashfunc<Blob<224>>(pInfo->hash, pInfo->batch), pInfo );
     }
     else if(pInfo->hashbits == 256)
     {
-      test<uint256_t>( pInfo->hash, pInfo );
+      test<uint256_t>( hashfunc<uint256_t>(pInfo->hash, pInfo->batch), pInfo );
     }
     else
     {
@@ -1393,20 +1528,30 @@ int main ( int argc, const char ** argv )
   const char * defaulthash = "wyhash";
 #endif
   const char * hashToTest = defaulthash;
+  const char * cpulist = NULL;
+  bool onecpu = false;
+  std::vector<int> cpus;
+  bool priority = false;
 
   if(argc < 2) {
     printf("No test hash given on command line, testing %s.\n", hashToTest);
     printf("Usage: SMHasher [--list][--listnames][--tests] [--verbose][--extra]\n"
-           "       [--test=Speed,...] hash\n");
+           "       [--test=Speed,...] [--threads=N] [--keysizes=1-32,...] [--perf]\n"
+           "       [--cpu=N | --cpus=0,2-3] [--priority] [--keys=FILE|uuid|url|int64|log]\n"
+           "       [--profile=read/write/erase,hit,load[,grow]]\n"
+           "       hash\n");
   }
   else {
     int i = 1;
     hashToTest = argv[i];
 
-    if (strncmp(hashToTest,"--", 2) == 0) {
+    while (strncmp(hashToTest,"--", 2) == 0) {
       if (strcmp(hashToTest,"--help") == 0) {
         printf("Usage: SMHasher [--list][--listnames][--tests] [--verbose][--extra]\n"
-               "       [--test=Speed,...] hash\n");
+               "       [--test=Speed,...] [--threads=N] [--keysizes=1-32,...] [--perf]\n"
+               "       [--cpu=N | --cpus=0,2-3] [--priority] [--keys=FILE|uuid|url|int64|log]\n"
+               "       [--profile=read/write/erase,hit,load[,grow]]\n"
+               "       hash\n");
         exit(0);
       }
       if (strcmp(hashToTest,"--list") == 0) {
@@ -1430,22 +1575,60 @@ int main ( int argc, const char ** argv )
       }
       if (strcmp(hashToTest,"--verbose") == 0) {
         g_drawDiagram = true;
-        i++;
-        if (argc > i)
-          hashToTest = argv[i];
-        else
-          hashToTest = defaulthash;
       }
-      if (strcmp(hashToTest,"--extra") == 0) {
+      else if (strcmp(hashToTest,"--extra") == 0) {
         g_testExtra = true;
-        i++;
-        if (argc > i)
-          hashToTest = argv[i];
-        else
-          hashToTest = defaulthash;
+      }
+      /* number of tests to run concurrently. default: 1 */
+      else if (strncmp(hashToTest,"--threads=", 10) == 0) {
+        int n = atoi(&hashToTest[10]);
+        if (n < 1) {
+          printf("Invalid option: %s\n", hashToTest);
+          exit(1);
+        }
+        g_NCPU = (unsigned)n;
+      }
+      /* pin the run to one CPU, or restrict it to a list like 0,4-7 with
+         the single-threaded tests pinned to the first */
+      else if (strncmp(hashToTest,"--cpu=", 6) == 0 ||
+               strncmp(hashToTest,"--cpus=", 7) == 0) {
+        cpulist = strchr(hashToTest, '=') + 1;
+        onecpu = hashToTest[5] == '=';
+        if (!ParseCPUList(cpulist, cpus) || (onecpu && cpus.size() != 1)) {
+          printf("Invalid option: %s\n", hashToTest);
+          exit(1);
+        }
+      }
+      else if (strcmp(hashToTest,"--priority") == 0) {
+        priority = true;
+      }
+      /* hardware performance counters in the speed tests, if available */
+      else if (strcmp(hashToTest,"--perf") == 0) {
+        g_perf = PerfOpen();
+      }
+      /* keys of the hashmap tests: a file, binary:FILE, or uuid, url, int64, log */
+      else if (strncmp(hashToTest,"--keys=", 7) == 0) {
+        g_keys = &hashToTest[7];
+      }
+      /* extra workload of the HashmapProfiles test, e.g. 80/15/5,90,0.75 */
+      else if (strncmp(hashToTest,"--profile=", 10) == 0) {
+        if (!ParseHashMapProfile(&hashToTest[10], g_profile)) {
+          printf("Invalid option: %s\n", hashToTest);
+          exit(1);
+        }
+        g_customProfile = true;
+      }
+      /* key sizes for the throughput speed test, e.g. 1-32 or 8:3,64:1 */
+      else if (strncmp(hashToTest,"--keysizes=", 11) == 0) {
+        std::vector<int> keysizes;
+        if (!ParseKeySizes(&hashToTest[11], keysizes)) {
+          printf("Invalid option: %s\n", hashToTest);
+          exit(1);
+        }
+        g_keysizes = &hashToTest[11];
       }
       /* default: --test=All. comma seperated list of options */
-      if (strncmp(hashToTest,"--test=", 6) == 0) {
+      else if (strncmp(hashToTest,"--test=", 7) == 0) {
         char *opt = (char *)&hashToTest[7];
         char *rest = opt;
         char *p;
@@ -1474,6 +1657,10 @@ int main ( int argc, const char ** argv )
           }
         } while (p);
       }
+      else {
+        printf("Invalid option: %s\n", hashToTest);
+        exit(1);
+      }
       i++;
       if (argc > i)
         hashToTest = argv[i];
@@ -1482,8 +1669,29 @@ int main ( int argc, const char ** argv )
     }
   }
 
-  // Code runs on the 3rd CPU by default? only for speed tests
-  //SetAffinity((1 << 2));
+  // recorded with the results, as they affect the speed tests
+  if (cpulist) {
+    if (!SetAffinity(cpus) || !PinThread(cpus[0]))
+      printf("WARNING: Could not set CPU affinity to %s\n", cpulist);
+    else if (onecpu)
+      printf("--- Pinned to CPU %d\n", cpus[0]);
+    else {
+      printf("--- Restricted to CPUs %s, single-threaded tests pinned to CPU %d\n",
+             cpulist, cpus[0]);
+      g_cpus = cpus;
+    }
+  }
+  if (priority) {
+    if (RaisePriority())
+      printf("--- Scheduling priority raised\n");
+    else
+      printf("WARNING: Could not raise the scheduling priority\n");
+  }
+  if (g_testAll || g_testSpeed || g_testHashmap || g_testBulkSweep || g_testScaling ||
+      g_testHashmapConcurrent || g_testHashmapProfiles) {
+    AvailableCPUs(cpus);
+    CheckCPUFrequency(cpus);
+  }
   //SelfTest();
 
   int timeBegin = clock();
@@ -1491,16 +1699,18 @@ int main ( int argc, const char ** argv )
   testHash(hashToTest);
 
   int timeEnd = clock();
+  // CPU time, including the worker processes of --threads
+  double timeTaken = double(timeEnd-timeBegin)/double(CLOCKS_PER_SEC) + ChildCPUSeconds();
 
   printf("\n");
   fflush(NULL);
   if (g_testAll) {
     printf("Input vcode 0x%08x, Output vcode 0x%08x, Result vcode 0x%08x\n", g_inputVCode, g_outputVCode, g_resultVCode);
-    printf("Verification value is 0x%08x - Testing took %f seconds\n", g_verify, double(timeEnd-timeBegin)/double(CLOCKS_PER_SEC));
+    printf("Verification value is 0x%08x - Testing took %f seconds\n", g_verify, timeTaken);
     printf("-------------------------------------------------------------------------------\n");
   } else {
     fprintf(stderr, "Input vcode 0x%08x, Output vcode 0x%08x, Result vcode 0x%08x\n", g_inputVCode, g_outputVCode, g_resultVCode);
-    fprintf(stderr, "Verification value is 0x%08x - Testing took %f seconds\n", g_verify, double(timeEnd-timeBegin)/double(CLOCKS_PER_SEC));
+    fprintf(stderr, "Verification value is 0x%08x - Testing took %f seconds\n", g_verify, timeTaken);
   }
     fflush(NULL);
   return 0;